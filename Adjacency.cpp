@@ -0,0 +1,140 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "Adjacency.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "LinkInterner.hpp"
+
+namespace {
+    auto hasNonUnitWeight(const std::vector<std::vector<Edge>> &rows) -> bool {
+        return std::any_of(rows.cbegin(), rows.cend(), [](const std::vector<Edge> &row) {
+            return std::any_of(row.cbegin(), row.cend(), [](const Edge &edge) { return edge.weight != 1.0; });
+        });
+    }
+}
+
+CompactAdjacency::CompactAdjacency(const std::vector<std::vector<Edge>> &rows) {
+    const auto weighted = hasNonUnitWeight(rows);
+    offsets.reserve(rows.size() + 1);
+    for (const auto &row: rows) {
+        for (const auto &[id, weight]: row) {
+            targets.push_back(id);
+            if (weighted) {
+                weights.push_back(weight);
+            }
+        }
+        offsets.push_back(targets.size());
+    }
+    targets.shrink_to_fit();
+    weights.shrink_to_fit();
+}
+
+CompactAdjacency::CompactAdjacency(PlanCache::Reader &&reader) {
+    reader.read(offsets);
+    reader.read(targets);
+    reader.read(weights);
+}
+
+void CompactAdjacency::save(PlanCache::Writer &writer) const {
+    writer.write(offsets);
+    writer.write(targets);
+    writer.write(weights);
+}
+
+auto CompactAdjacency::memoryUsage() const -> size_t {
+    return offsets.capacity() * sizeof(uint64_t) + targets.capacity() * sizeof(VariableId) +
+           weights.capacity() * sizeof(double);
+}
+
+EncodedAdjacency::EncodedAdjacency(const std::vector<std::vector<Edge>> &rows) {
+    const auto weighted = hasNonUnitWeight(rows);
+    edgeOffsets.reserve(rows.size() + 1);
+    byteOffsets.reserve(rows.size() + 1);
+    for (auto row: rows) {
+        std::sort(row.begin(), row.end(), [](const Edge &lhs, const Edge &rhs) { return lhs.id < rhs.id; });
+        auto previous = VariableId{0};
+        for (const auto &[id, weight]: row) {
+            auto gap = id - previous;
+            previous = id;
+            while (gap >= 0x80) {
+                bytes.push_back(static_cast<uint8_t>(gap | 0x80));
+                gap >>= 7;
+            }
+            bytes.push_back(static_cast<uint8_t>(gap));
+            if (weighted) {
+                weights.push_back(weight);
+            }
+        }
+        edgeOffsets.push_back(edgeOffsets.back() + row.size());
+        byteOffsets.push_back(bytes.size());
+    }
+    bytes.shrink_to_fit();
+    weights.shrink_to_fit();
+}
+
+auto EncodedAdjacency::memoryUsage() const -> size_t {
+    return (edgeOffsets.capacity() + byteOffsets.capacity()) * sizeof(uint64_t) + bytes.capacity() +
+           weights.capacity() * sizeof(double);
+}
+
+auto SharedRunAdjacency::Row::runs() const -> std::vector<Run> {
+    std::vector<Run> result;
+    for (auto node = head; node != END; node = adjacency->nodes[node].next) {
+        const auto &current = adjacency->nodes[node];
+        result.push_back({current.firstRank, current.length, adjacency->constants[current.weight]});
+    }
+    return result;
+}
+
+SharedRunAdjacency::SharedRunAdjacency(const std::vector<std::vector<Edge>> &rows,
+                                       const HugePageVector<VariableId> &ranks,
+                                       const HugePageVector<VariableId> &order) : order(order.data()) {
+    LinkInterner<Node, &Node::weight> interned(nodes);
+    std::unordered_map<double, uint32_t> constantIndices;
+    heads.reserve(rows.size());
+    counts.reserve(rows.size());
+    std::vector<Node> runs;
+    for (const auto &row: rows) {
+        runs.clear();
+        for (const auto &[id, weight]: row) {
+            const auto [constant, added] = constantIndices.try_emplace(weight, constants.size());
+            if (added) {
+                constants.push_back(weight);
+            }
+            if (!runs.empty() && runs.back().firstRank + runs.back().length == ranks[id] &&
+                runs.back().weight == constant->second) {
+                ++runs.back().length;
+                continue;
+            }
+            runs.push_back({ranks[id], 1, constant->second, END});
+        }
+        heads.push_back(interned.chain(runs));
+        counts.push_back(static_cast<uint32_t>(row.size()));
+    }
+    nodes.shrink_to_fit();
+    constants.shrink_to_fit();
+}
+
+SharedRunAdjacency::SharedRunAdjacency(PlanCache::Reader &&reader, const HugePageVector<VariableId> &order)
+        : order(order.data()) {
+    reader.read(heads);
+    reader.read(counts);
+    reader.read(nodes);
+    reader.read(constants);
+}
+
+void SharedRunAdjacency::save(PlanCache::Writer &writer) const {
+    writer.write(heads);
+    writer.write(counts);
+    writer.write(nodes);
+    writer.write(constants);
+}
+
+auto SharedRunAdjacency::memoryUsage() const -> size_t {
+    return (heads.capacity() + counts.capacity()) * sizeof(uint32_t) + nodes.capacity() * sizeof(Node) +
+           constants.capacity() * sizeof(double);
+}
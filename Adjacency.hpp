@@ -0,0 +1,337 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_ADJACENCY_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_ADJACENCY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "HugePageAllocator.hpp"
+#include "PlanCache.hpp"
+
+/// Internal variable ids; graphs are limited to 2^32 variables so every stored id takes 4 bytes
+using VariableId = uint32_t;
+
+struct Edge {
+    VariableId id;
+    double weight;
+};
+
+/// Rows of edges in CSR form: one id array, one weight array (left empty when every weight is 1),
+/// and row offsets into both. Used for structures read on the update hot path.
+class CompactAdjacency {
+public:
+    class Iterator {
+    private:
+        const VariableId *id = nullptr;
+        /// null when every weight is 1
+        const double *weight = nullptr;
+
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = Edge;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Edge;
+
+        Iterator() = default;
+
+        Iterator(const VariableId *id, const double *weight) : id(id), weight(weight) {}
+
+        auto operator*() const -> Edge { return {*id, weight ? *weight : 1.0}; }
+
+        auto operator[](const difference_type offset) const -> Edge { return *(*this + offset); }
+
+        auto operator++() -> Iterator & {
+            ++id;
+            weight += weight != nullptr;
+            return *this;
+        }
+
+        auto operator++(int) -> Iterator {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        auto operator+(const difference_type offset) const -> Iterator {
+            return {id + offset, weight ? weight + offset : nullptr};
+        }
+
+        auto operator-(const Iterator &other) const -> difference_type { return id - other.id; }
+
+        auto operator==(const Iterator &other) const -> bool { return id == other.id; }
+    };
+
+    class Row {
+    private:
+        Iterator first;
+        size_t count = 0;
+
+    public:
+        Row(Iterator first, size_t count) : first(first), count(count) {}
+
+        [[nodiscard]] auto begin() const -> Iterator { return first; }
+
+        [[nodiscard]] auto end() const -> Iterator { return first + static_cast<std::ptrdiff_t>(count); }
+
+        [[nodiscard]] auto cbegin() const -> Iterator { return begin(); }
+
+        [[nodiscard]] auto cend() const -> Iterator { return end(); }
+
+        [[nodiscard]] auto operator[](const size_t index) const -> Edge {
+            return first[static_cast<std::ptrdiff_t>(index)];
+        }
+
+        [[nodiscard]] auto size() const -> size_t { return count; }
+
+        [[nodiscard]] auto empty() const -> bool { return !count; }
+    };
+
+private:
+    HugePageVector<uint64_t> offsets{0};
+    HugePageVector<VariableId> targets;
+    HugePageVector<double> weights;
+
+public:
+    CompactAdjacency() = default;
+
+    explicit CompactAdjacency(const std::vector<std::vector<Edge>> &rows);
+
+    explicit CompactAdjacency(PlanCache::Reader &&reader);
+
+    void save(PlanCache::Writer &writer) const;
+
+    [[nodiscard]] auto operator[](const size_t row) const -> Row {
+        return {{targets.data() + offsets[row], weights.empty() ? nullptr : weights.data() + offsets[row]},
+                offsets[row + 1] - offsets[row]};
+    }
+
+    [[nodiscard]] auto size() const -> size_t { return offsets.size() - 1; }
+
+    [[nodiscard]] auto memoryUsage() const -> size_t;
+};
+
+/// Rows of edges sorted by id, with the ids stored as LEB128 varints of the gap to the previous id.
+/// Typically 1-2 bytes per id instead of 4; meant for cold structures that are only scanned.
+class EncodedAdjacency {
+public:
+    class Iterator {
+    private:
+        const uint8_t *cursor = nullptr;
+        const double *weight = nullptr;
+        size_t remaining = 0;
+        VariableId current = 0;
+
+        void decode() {
+            // single-byte gaps are by far the most common case in sorted adjacency
+            uint32_t gap = *cursor & 0x7F;
+            if (*cursor++ & 0x80) {
+                for (auto shift = 7; *(cursor - 1) & 0x80; shift += 7) {
+                    gap |= static_cast<uint32_t>(*cursor & 0x7F) << shift;
+                    ++cursor;
+                }
+            }
+            current += gap;
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Edge;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Edge;
+
+        Iterator() = default;
+
+        Iterator(const uint8_t *cursor, const double *weight, const size_t remaining)
+                : cursor(cursor), weight(weight), remaining(remaining) {
+            if (remaining) {
+                decode();
+            }
+        }
+
+        auto operator*() const -> Edge { return {current, weight ? *weight : 1.0}; }
+
+        auto operator++() -> Iterator & {
+            weight += weight != nullptr;
+            if (--remaining) {
+                decode();
+            }
+            return *this;
+        }
+
+        auto operator++(int) -> Iterator {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        auto operator==(const Iterator &other) const -> bool { return remaining == other.remaining; }
+    };
+
+    class Row {
+    private:
+        Iterator first;
+        size_t count = 0;
+
+    public:
+        Row(Iterator first, size_t count) : first(first), count(count) {}
+
+        [[nodiscard]] auto begin() const -> Iterator { return first; }
+
+        [[nodiscard]] auto end() const -> Iterator { return {}; }
+
+        [[nodiscard]] auto cbegin() const -> Iterator { return begin(); }
+
+        [[nodiscard]] auto cend() const -> Iterator { return end(); }
+
+        [[nodiscard]] auto size() const -> size_t { return count; }
+
+        [[nodiscard]] auto empty() const -> bool { return !count; }
+    };
+
+private:
+    HugePageVector<uint64_t> edgeOffsets{0};
+    HugePageVector<uint64_t> byteOffsets{0};
+    HugePageVector<uint8_t> bytes;
+    HugePageVector<double> weights;
+
+public:
+    EncodedAdjacency() = default;
+
+    explicit EncodedAdjacency(const std::vector<std::vector<Edge>> &rows);
+
+    [[nodiscard]] auto operator[](const size_t row) const -> Row {
+        const auto count = edgeOffsets[row + 1] - edgeOffsets[row];
+        return {{bytes.data() + byteOffsets[row], weights.empty() ? nullptr : weights.data() + edgeOffsets[row], count},
+                count};
+    }
+
+    [[nodiscard]] auto size() const -> size_t { return edgeOffsets.size() - 1; }
+
+    [[nodiscard]] auto memoryUsage() const -> size_t;
+};
+
+/// Rows of edges sorted by the rank of their targets, stored as chains of runs: a run is a range of consecutive
+/// ranks sharing one weight, and rows ending in the same runs share one copy of that tail. Expanded on the fly,
+/// in rank order, through the rank -> id order it was built with, which must outlive it. Suits closures in a
+/// topological order that keeps descendants together: they are a few runs each, and since the closure of a
+/// variable is itself followed by the closure of what it feeds, whole tails toward the sinks are shared.
+class SharedRunAdjacency {
+public:
+    struct Run {
+        VariableId firstRank;
+        uint32_t length;
+        double weight;
+    };
+
+    static constexpr uint32_t END = UINT32_MAX;
+
+private:
+    struct Node {
+        VariableId firstRank;
+        uint32_t length;
+        /// index into the constant pool
+        uint32_t weight;
+        uint32_t next;
+    };
+
+public:
+    class Iterator {
+    private:
+        const SharedRunAdjacency *adjacency = nullptr;
+        uint32_t node = END;
+        uint32_t offset = 0;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Edge;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Edge;
+
+        Iterator() = default;
+
+        Iterator(const SharedRunAdjacency *adjacency, const uint32_t node) : adjacency(adjacency), node(node) {}
+
+        auto operator*() const -> Edge {
+            const auto &current = adjacency->nodes[node];
+            return {adjacency->order[current.firstRank + offset], adjacency->constants[current.weight]};
+        }
+
+        auto operator++() -> Iterator & {
+            if (++offset == adjacency->nodes[node].length) {
+                node = adjacency->nodes[node].next;
+                offset = 0;
+            }
+            return *this;
+        }
+
+        auto operator++(int) -> Iterator {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        auto operator==(const Iterator &other) const -> bool { return node == other.node && offset == other.offset; }
+    };
+
+    class Row {
+    private:
+        const SharedRunAdjacency *adjacency;
+        uint32_t head;
+        size_t count;
+
+    public:
+        Row(const SharedRunAdjacency *adjacency, uint32_t head, size_t count)
+                : adjacency(adjacency), head(head), count(count) {}
+
+        [[nodiscard]] auto begin() const -> Iterator { return {adjacency, head}; }
+
+        [[nodiscard]] auto end() const -> Iterator { return {adjacency, END}; }
+
+        [[nodiscard]] auto cbegin() const -> Iterator { return begin(); }
+
+        [[nodiscard]] auto cend() const -> Iterator { return end(); }
+
+        [[nodiscard]] auto size() const -> size_t { return count; }
+
+        [[nodiscard]] auto empty() const -> bool { return !count; }
+
+        [[nodiscard]] auto runs() const -> std::vector<Run>;
+    };
+
+private:
+    const VariableId *order = nullptr;
+    HugePageVector<uint32_t> heads;
+    HugePageVector<uint32_t> counts;
+    HugePageVector<Node> nodes;
+    HugePageVector<double> constants;
+
+public:
+    SharedRunAdjacency() = default;
+
+    /// rows sorted by rank, with ranks[id] the rank of id and order the inverse
+    SharedRunAdjacency(const std::vector<std::vector<Edge>> &rows, const HugePageVector<VariableId> &ranks,
+                       const HugePageVector<VariableId> &order);
+
+    SharedRunAdjacency(PlanCache::Reader &&reader, const HugePageVector<VariableId> &order);
+
+    void save(PlanCache::Writer &writer) const;
+
+    [[nodiscard]] auto operator[](const size_t row) const -> Row { return {this, heads[row], counts[row]}; }
+
+    [[nodiscard]] auto size() const -> size_t { return heads.size(); }
+
+    /// distinct runs over all rows
+    [[nodiscard]] auto runCount() const -> size_t { return nodes.size(); }
+
+    [[nodiscard]] auto memoryUsage() const -> size_t;
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_ADJACENCY_HPP
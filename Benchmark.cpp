@@ -0,0 +1,242 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "Adjacency.hpp"
+#include "HugePageAllocator.hpp"
+#include "PropagationPlans.hpp"
+#include "VariableLock.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Plan execution over a large variable store: random closures made of short runs of ranks in a random
+// topological order, compiled into PropagationPlans and executed with the loops of the eager path of
+// VariableSystem::updateVariable (lock chain, apply chain, unlock, every id looked up through the order, with its
+// prefetching), minus its bookkeeping. A second kernel runs the input scan of VariableSystem::checkConsistency: random
+// sums over varint-encoded rows of inputs, each with the second cursor of VariableSystem::aggregate running ahead.
+// Data TLB misses are counted through perf_event_open.
+
+namespace {
+    /// Counts user-space data TLB read misses of the calling thread while alive; empty when perf is unavailable
+    class TlbMissCounter {
+    private:
+        int descriptor = -1;
+
+    public:
+        TlbMissCounter() {
+            perf_event_attr attributes{};
+            attributes.size = sizeof(attributes);
+            attributes.type = PERF_TYPE_HW_CACHE;
+            attributes.config = PERF_COUNT_HW_CACHE_DTLB |
+                                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attributes.disabled = 1;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            descriptor = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+            if (descriptor >= 0) {
+                ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+                ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+
+        TlbMissCounter(const TlbMissCounter &) = delete;
+
+        auto operator=(const TlbMissCounter &) -> TlbMissCounter & = delete;
+
+        ~TlbMissCounter() {
+            if (descriptor >= 0) {
+                close(descriptor);
+            }
+        }
+
+        [[nodiscard]] auto read() const -> std::optional<uint64_t> {
+            if (descriptor < 0) { return std::nullopt; }
+            ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t count = 0;
+            if (::read(descriptor, &count, sizeof(count)) != sizeof(count)) { return std::nullopt; }
+            return count;
+        }
+    };
+
+    struct Configuration {
+        size_t variableCount = size_t{1} << 26;
+        size_t closureCount = size_t{1} << 14;
+        size_t closureSize = 32;
+        /// runs are 1 to this many consecutive ranks long, with one of two weights each
+        uint32_t maxRunLength = 4;
+        size_t updateCount = size_t{1} << 20;
+        size_t scanRowCount = size_t{1} << 16;
+        size_t scanFanIn = 64;
+    };
+
+    /// Prints the time and dTLB misses per access of a kernel, and what backs the arrays it still has mapped
+    void printAccessCosts(const std::string &label, const std::chrono::duration<double, std::nano> elapsed,
+                          const size_t accessCount, const std::optional<uint64_t> misses) {
+        const auto accesses = static_cast<double>(accessCount);
+        std::cout << label << ": " << elapsed.count() / accesses << " ns/access, dTLB misses/access = ";
+        if (misses) {
+            std::cout << static_cast<double>(*misses) / accesses;
+        } else {
+            std::cout << "n/a (perf_event_open unavailable)";
+        }
+        const auto statistics = HugePages::statistics();
+        std::cout << "\n    MAPPED BYTES: explicit huge = " << statistics.explicitBytes
+                  << ", transparent huge = " << statistics.transparentBytes
+                  << ", regular = " << statistics.regularBytes << '\n';
+    }
+
+    void runClosureApplication(const Configuration &configuration, const bool hugePages, const size_t distance) {
+        HugePages::setEnabled(hugePages);
+        std::mt19937_64 generator(42);
+        HugePageVector<double> values(configuration.variableCount, 0.0);
+        HugePageVector<VariableLock> locks(configuration.variableCount);
+        HugePageVector<VariableId> order(configuration.variableCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), generator);
+        HugePageVector<VariableId> ranks(configuration.variableCount);
+        for (VariableId rank = 0; rank < configuration.variableCount; ++rank) {
+            ranks[order[rank]] = rank;
+        }
+        std::vector<std::vector<Edge>> rows(configuration.closureCount);
+        for (auto &row: rows) {
+            std::vector<VariableId> closureRanks;
+            while (closureRanks.size() < configuration.closureSize) {
+                const auto first = static_cast<VariableId>(generator() % configuration.variableCount);
+                const auto length = 1 + static_cast<uint32_t>(generator() % configuration.maxRunLength);
+                for (VariableId rank = first; rank < first + length && rank < configuration.variableCount; ++rank) {
+                    closureRanks.push_back(rank);
+                }
+            }
+            std::sort(closureRanks.begin(), closureRanks.end());
+            closureRanks.erase(std::unique(closureRanks.begin(), closureRanks.end()), closureRanks.end());
+            for (const auto rank: closureRanks) {
+                row.push_back({order[rank], 1.0 + static_cast<double>(rank / configuration.maxRunLength % 2)});
+            }
+        }
+        const SharedRunAdjacency closures(rows, ranks, order);
+        const PropagationPlans plans(closures, std::vector<bool>(configuration.closureCount, true));
+        std::vector<uint32_t> schedule(configuration.updateCount);
+        for (auto &primary: schedule) {
+            primary = static_cast<uint32_t>(generator() % configuration.closureCount);
+        }
+
+        const TlbMissCounter tlbMisses;
+        const auto start = std::chrono::steady_clock::now();
+        size_t accessCount = 0;
+        for (const auto primary: schedule) {
+            const auto plan = plans[primary];
+            PropagationPlans::RankCursor lockAhead(plan.locks(), distance);
+            for (const auto &instruction: plan.locks()) {
+                const auto runEnd = instruction.firstRank + instruction.length;
+                for (auto rank = instruction.firstRank; rank < runEnd; ++rank) {
+                    if (distance && !lockAhead.done()) {
+                        __builtin_prefetch(&locks[order[lockAhead.rank()]], 1);
+                        lockAhead.advance();
+                    }
+                    locks[order[rank]].lock();
+                }
+            }
+            PropagationPlans::RankCursor applyAhead(plan.applies(), distance);
+            for (const auto &instruction: plan.applies()) {
+                const auto runEnd = instruction.firstRank + instruction.length;
+                const auto runDelta = plans.multiplier(instruction);
+                for (auto rank = instruction.firstRank; rank < runEnd; ++rank) {
+                    if (distance && !applyAhead.done()) {
+                        __builtin_prefetch(&values[order[applyAhead.rank()]], 1);
+                        applyAhead.advance();
+                    }
+                    values[order[rank]] += runDelta;
+                    ++accessCount;
+                }
+            }
+            for (const auto &instruction: plan.locks()) {
+                for (auto rank = instruction.firstRank; rank < instruction.firstRank + instruction.length; ++rank) {
+                    locks[order[rank]].unlock();
+                }
+            }
+        }
+        const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+        const auto misses = tlbMisses.read();
+
+        // read while this run's arrays are still mapped
+        printAccessCosts(std::string(hugePages ? "huge pages   " : "regular pages") + ", prefetch distance " +
+                         std::to_string(distance), elapsed, accessCount, misses);
+    }
+
+    void runInputScan(const Configuration &configuration, const size_t distance) {
+        HugePages::setEnabled(true);
+        std::mt19937_64 generator(42);
+        HugePageVector<double> values(configuration.variableCount);
+        for (auto &value: values) {
+            value = static_cast<double>(generator() % 1024);
+        }
+        std::vector<std::vector<Edge>> rows(configuration.scanRowCount);
+        for (auto &row: rows) {
+            while (row.size() < configuration.scanFanIn) {
+                row.push_back({static_cast<VariableId>(generator() % configuration.variableCount),
+                               1.0 + static_cast<double>(generator() % 2)});
+            }
+            std::sort(row.begin(), row.end(), [](const Edge &lhs, const Edge &rhs) { return lhs.id < rhs.id; });
+            row.erase(std::unique(row.begin(), row.end(),
+                                  [](const Edge &lhs, const Edge &rhs) { return lhs.id == rhs.id; }), row.end());
+        }
+        const EncodedAdjacency dependencies(rows);
+
+        const TlbMissCounter tlbMisses;
+        const auto start = std::chrono::steady_clock::now();
+        size_t accessCount = 0;
+        auto total = 0.0;
+        for (size_t row = 0; row < dependencies.size(); ++row) {
+            const auto deps = dependencies[row];
+            auto ahead = deps.cbegin();
+            for (size_t step = 0; step < distance && ahead != deps.cend(); ++step, ++ahead) {
+                __builtin_prefetch(&values[(*ahead).id]);
+            }
+            auto partialSum = 0.0;
+            for (const auto &dep: deps) {
+                if (ahead != deps.cend()) {
+                    __builtin_prefetch(&values[(*ahead).id]);
+                    ++ahead;
+                }
+                partialSum += dep.weight * values[dep.id];
+                ++accessCount;
+            }
+            total += partialSum;
+        }
+        const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+        const auto misses = tlbMisses.read();
+        printAccessCosts("input scan, prefetch distance " + std::to_string(distance) + " (sum " +
+                         std::to_string(total) + ")", elapsed, accessCount, misses);
+    }
+}
+
+auto main(int argc, char **argv) -> int {
+    Configuration configuration;
+    if (argc > 1) { configuration.variableCount = std::stoull(argv[1]); }
+    if (argc > 2) { configuration.updateCount = std::stoull(argv[2]); }
+    std::cout << "VARIABLES = " << configuration.variableCount
+              << ", CLOSURES = " << configuration.closureCount
+              << ", CLOSURE SIZE = " << configuration.closureSize
+              << ", UPDATES = " << configuration.updateCount
+              << ", SCANNED ROWS = " << configuration.scanRowCount
+              << ", SCAN FAN-IN = " << configuration.scanFanIn << '\n';
+    runClosureApplication(configuration, false, 0);
+    for (const auto distance: {0, 2, 4, 8, 16}) {
+        runClosureApplication(configuration, true, distance);
+    }
+    for (const auto distance: {0, 2, 4, 8, 16}) {
+        runInputScan(configuration, distance);
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_BOUNDEDCACHE_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_BOUNDEDCACHE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "VariableLock.hpp"
+
+/// A concurrent cache of immutable values holding at most a fixed number of bytes, evicted by CLOCK, the usual
+/// approximation of LRU: a hit only sets the entry's referenced bit, with its shard locked in shared mode, and an
+/// insertion sweeps the shard's hand around its ring of entries, clearing set bits and evicting the first entry
+/// found clear. New entries go right behind the hand, so they get a whole sweep to be referenced. Keys are spread
+/// over shards by hash, but the byte budget is global: an insertion evicts from its own shard first and from the
+/// others in turn only when its own runs dry. Values are handed out as shared pointers, so an evicted value stays
+/// valid for as long as someone still uses it.
+template<typename Key, typename Value>
+class BoundedCache {
+public:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Insertion {
+        /// the value now cached under the key, which is another caller's if it inserted the key first
+        std::shared_ptr<const Value> value;
+        size_t evictions;
+    };
+
+private:
+    struct Entry {
+        Key key;
+        std::shared_ptr<const Value> value;
+        size_t bytes;
+        /// set by hits, cleared by the passing hand
+        std::atomic<bool> referenced{false};
+
+        Entry(const Key &key, std::shared_ptr<const Value> value, const size_t bytes)
+                : key(key), value(std::move(value)), bytes(bytes) {}
+    };
+
+    using Ring = std::list<Entry>;
+
+    struct alignas(64) Shard {
+        VariableLock lock;
+        Ring ring;
+        /// the next entry to examine; end() wraps around to the front
+        typename Ring::iterator hand = ring.end();
+        std::unordered_map<Key, typename Ring::iterator> entries;
+    };
+
+    const size_t capacity;
+    /// bytes of the cached entries, and of those about to be inserted
+    std::atomic<size_t> totalBytes{0};
+    std::array<Shard, SHARD_COUNT> shards;
+
+    [[nodiscard]] static auto shardIndex(const Key &key) -> size_t { return std::hash<Key>{}(key) % SHARD_COUNT; }
+
+    /// Removes one entry from a non-empty shard; the caller holds the shard's lock exclusively
+    void evict(Shard &shard) {
+        for (;;) {
+            if (shard.hand == shard.ring.end()) {
+                shard.hand = shard.ring.begin();
+            }
+            if (shard.hand->referenced.exchange(false, std::memory_order_relaxed)) {
+                ++shard.hand;
+                continue;
+            }
+            totalBytes.fetch_sub(shard.hand->bytes, std::memory_order_relaxed);
+            shard.entries.erase(shard.hand->key);
+            shard.hand = shard.ring.erase(shard.hand);
+            return;
+        }
+    }
+
+public:
+    explicit BoundedCache(const size_t capacityBytes) : capacity(capacityBytes) {}
+
+    BoundedCache(const BoundedCache &) = delete;
+
+    auto operator=(const BoundedCache &) -> BoundedCache & = delete;
+
+    /// The cached value, or null on a miss
+    [[nodiscard]] auto find(const Key &key) -> std::shared_ptr<const Value> {
+        auto &shard = shards[shardIndex(key)];
+        const std::shared_lock lockGuard(shard.lock);
+        const auto entry = shard.entries.find(key);
+        if (entry == shard.entries.end()) {
+            return nullptr;
+        }
+        // only written when clear, so hits on a hot entry leave its cache line shared
+        if (!entry->second->referenced.load(std::memory_order_relaxed)) {
+            entry->second->referenced.store(true, std::memory_order_relaxed);
+        }
+        return entry->second->value;
+    }
+
+    /// Caches value under key, evicting as many entries as it takes to stay within the capacity. A value larger
+    /// than the whole capacity is returned without being cached, and so is one that finds the cache empty but the
+    /// capacity claimed by insertions still in progress
+    auto insert(const Key &key, std::shared_ptr<const Value> value, const size_t bytes) -> Insertion {
+        if (bytes > capacity) {
+            return {std::move(value), 0};
+        }
+        if (auto cached = find(key)) {
+            return {std::move(cached), 0};
+        }
+        // room is made first and then claimed, so the cached bytes never exceed the capacity; victims come from
+        // the key's own shard until it runs dry, then from the next ones, each shard locked on its own
+        size_t evictions = 0;
+        const auto home = shardIndex(key);
+        auto victims = home;
+        size_t emptyShards = 0;
+        for (auto current = totalBytes.load(std::memory_order_relaxed);;) {
+            if (current + bytes <= capacity) {
+                if (totalBytes.compare_exchange_weak(current, current + bytes, std::memory_order_relaxed)) { break; }
+                continue;
+            }
+            if (emptyShards == SHARD_COUNT) {
+                return {std::move(value), evictions};
+            }
+            {
+                auto &shard = shards[victims];
+                const std::lock_guard lockGuard(shard.lock);
+                if (shard.ring.empty()) {
+                    ++emptyShards;
+                    victims = (victims + 1) % SHARD_COUNT;
+                } else {
+                    emptyShards = 0;
+                    evict(shard);
+                    ++evictions;
+                }
+            }
+            current = totalBytes.load(std::memory_order_relaxed);
+        }
+        auto &shard = shards[home];
+        const std::lock_guard lockGuard(shard.lock);
+        if (const auto entry = shard.entries.find(key); entry != shard.entries.end()) {
+            totalBytes.fetch_sub(bytes, std::memory_order_relaxed);
+            return {entry->second->value, evictions};
+        }
+        const auto entry = shard.ring.emplace(shard.hand, key, std::move(value), bytes);
+        shard.entries.emplace(key, entry);
+        return {entry->value, evictions};
+    }
+
+    [[nodiscard]] auto memoryUsage() const -> size_t { return totalBytes.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] auto entryCount() -> size_t {
+        size_t count = 0;
+        for (auto &shard: shards) {
+            const std::shared_lock lockGuard(shard.lock);
+            count += shard.entries.size();
+        }
+        return count;
+    }
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_BOUNDEDCACHE_HPP
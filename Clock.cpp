@@ -0,0 +1,102 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "Clock.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+namespace {
+    /// the participant the calling thread attached as
+    thread_local size_t currentParticipant = SIZE_MAX;
+}
+
+auto SteadyClock::now() -> TimePoint {
+    return std::chrono::steady_clock::now();
+}
+
+void SteadyClock::sleepFor(const Duration duration) {
+    std::this_thread::sleep_for(duration);
+}
+
+void SteadyClock::stall(const Duration duration) {
+    std::this_thread::sleep_for(duration);
+}
+
+VirtualClock::VirtualClock(const uint64_t seed) : generator(seed) {}
+
+auto VirtualClock::now() -> TimePoint {
+    const std::lock_guard lock(mutex);
+    return TimePoint{} + elapsed;
+}
+
+void VirtualClock::expect(const size_t participantCount) {
+    const std::lock_guard lock(mutex);
+    assert(running == NOBODY && "Participants can only be announced between runs");
+    participants.assign(participantCount, {elapsed, false});
+    attached = 0;
+}
+
+void VirtualClock::attach(const size_t participant) {
+    std::unique_lock lock(mutex);
+    assert(participant < participants.size() && "Participant was not announced");
+    currentParticipant = participant;
+    participants[participant] = {elapsed, true};
+    // nobody runs before everyone is there, so the first turn does not depend on thread start-up order
+    if (++attached == participants.size()) {
+        scheduleNext();
+    }
+    waitForTurn(lock, participant);
+}
+
+void VirtualClock::detach() {
+    const std::lock_guard lock(mutex);
+    assert(running == currentParticipant && "Only the running participant can detach");
+    participants[currentParticipant].active = false;
+    scheduleNext();
+}
+
+void VirtualClock::sleepFor(const Duration duration) {
+    std::unique_lock lock(mutex);
+    assert(running == currentParticipant && "Only the running participant can sleep");
+    participants[currentParticipant].wakeTime = elapsed + duration;
+    scheduleNext();
+    waitForTurn(lock, currentParticipant);
+}
+
+void VirtualClock::stall(const Duration duration) {
+    const std::lock_guard lock(mutex);
+    elapsed += duration;
+}
+
+void VirtualClock::scheduleNext() {
+    auto earliest = Duration::max();
+    size_t candidates = 0;
+    for (const auto &participant: participants) {
+        if (!participant.active) { continue; }
+        if (participant.wakeTime < earliest) {
+            earliest = participant.wakeTime;
+            candidates = 0;
+        }
+        candidates += participant.wakeTime == earliest;
+    }
+    running = NOBODY;
+    if (!candidates) {
+        return;
+    }
+    auto chosen = std::uniform_int_distribution<size_t>(0, candidates - 1)(generator);
+    for (size_t index = 0; index < participants.size(); ++index) {
+        if (participants[index].active && participants[index].wakeTime == earliest && !chosen--) {
+            running = index;
+            break;
+        }
+    }
+    elapsed = std::max(elapsed, earliest);
+    turnChanged.notify_all();
+}
+
+void VirtualClock::waitForTurn(std::unique_lock<std::mutex> &lock, const size_t participant) {
+    turnChanged.wait(lock, [this, participant] { return running == participant; });
+}
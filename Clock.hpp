@@ -0,0 +1,99 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_CLOCK_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_CLOCK_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <vector>
+
+/// Where the threads of a VariableSystem get the time and wait. Threads taking part in a run attach with a
+/// number fixed by the system, not by start-up order, and detach when they finish.
+class Clock {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+    using Duration = std::chrono::nanoseconds;
+
+    virtual ~Clock() = default;
+
+    [[nodiscard]] virtual auto now() -> TimePoint = 0;
+
+    /// Announces how many participants the run has, before any of them attaches
+    virtual void expect(size_t participantCount) = 0;
+
+    virtual void attach(size_t participant) = 0;
+
+    virtual void detach() = 0;
+
+    /// Waits outside any lock: other threads get to run meanwhile
+    virtual void sleepFor(Duration duration) = 0;
+
+    /// Time spent working while holding locks: on a virtual clock it passes without letting anyone else run
+    virtual void stall(Duration duration) = 0;
+};
+
+/// Real time and real sleeps
+class SteadyClock final : public Clock {
+public:
+    [[nodiscard]] auto now() -> TimePoint override;
+
+    void expect(size_t /* participantCount */) override {}
+
+    void attach(size_t /* participant */) override {}
+
+    void detach() override {}
+
+    void sleepFor(Duration duration) override;
+
+    void stall(Duration duration) override;
+};
+
+/// Simulated time with a cooperative scheduler: exactly one participant runs at a time, until it sleeps; then
+/// time jumps to the earliest wake-up and that participant runs, ties broken by a seeded generator. Since
+/// participants only hand over between lock sets, a run is a pure function of the seed and takes no longer
+/// than its computation.
+class VirtualClock final : public Clock {
+private:
+    static constexpr size_t NOBODY = SIZE_MAX;
+
+    struct Participant {
+        Duration wakeTime{0};
+        bool active = false;
+    };
+
+    std::mutex mutex;
+    std::condition_variable turnChanged;
+    std::mt19937_64 generator;
+    Duration elapsed{0};
+    std::vector<Participant> participants;
+    size_t attached = 0;
+    size_t running = NOBODY;
+
+    /// requires the mutex
+    void scheduleNext();
+
+    void waitForTurn(std::unique_lock<std::mutex> &lock, size_t participant);
+
+public:
+    explicit VirtualClock(uint64_t seed);
+
+    [[nodiscard]] auto now() -> TimePoint override;
+
+    void expect(size_t participantCount) override;
+
+    void attach(size_t participant) override;
+
+    void detach() override;
+
+    void sleepFor(Duration duration) override;
+
+    void stall(Duration duration) override;
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_CLOCK_HPP
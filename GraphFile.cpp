@@ -0,0 +1,81 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "GraphFile.hpp"
+
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    constexpr std::array AGGREGATION_NAMES{
+            std::pair{"sum", VariableSystem::Aggregation::Sum},
+            std::pair{"min", VariableSystem::Aggregation::Min},
+            std::pair{"max", VariableSystem::Aggregation::Max},
+            std::pair{"count", VariableSystem::Aggregation::CountNonZero},
+            std::pair{"avg", VariableSystem::Aggregation::Average},
+    };
+}
+
+/* static */ auto GraphFile::parse(std::istream &input) -> std::vector<VariableSystem::Definition> {
+    std::vector<VariableSystem::Definition> definitions;
+    std::string line;
+    for (auto lineNumber = 1; std::getline(input, line); ++lineNumber) {
+        std::istringstream tokens(line);
+        std::string token;
+        if (!(tokens >> token) || token.starts_with('#')) { continue; }
+        auto &definition = definitions.emplace_back();
+        if (token == "primary") { continue; }
+        for (const auto &[name, aggregation]: AGGREGATION_NAMES) {
+            if (token == name) {
+                definition.aggregation = aggregation;
+                token.clear();
+                break;
+            }
+        }
+        do {
+            if (token.empty()) { continue; }
+            try {
+                const auto separator = token.find('*');
+                size_t consumed = 0;
+                const auto id = std::stoull(token.substr(0, separator), &consumed);
+                if (consumed != std::min(separator, token.size())) { throw std::invalid_argument(token); }
+                const auto weight = separator == std::string::npos ? 1.0 : std::stod(token.substr(separator + 1));
+                definition.dependencies.push_back({id, weight});
+            } catch (const std::logic_error &) {
+                throw std::runtime_error("line " + std::to_string(lineNumber) + ": malformed input '" + token + "'");
+            }
+        } while (tokens >> token);
+        if (definition.dependencies.empty()) {
+            throw std::runtime_error("line " + std::to_string(lineNumber) + ": secondary without inputs");
+        }
+    }
+    for (const auto &definition: definitions) {
+        for (const auto &dependency: definition.dependencies) {
+            if (dependency.id >= definitions.size()) {
+                throw std::runtime_error("input " + std::to_string(dependency.id) + " is not a variable");
+            }
+        }
+    }
+    return definitions;
+}
+
+/* static */ auto GraphFile::load(const std::string &path) -> std::vector<VariableSystem::Definition> {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    return parse(file);
+}
+
+/* static */ auto GraphFile::aggregationName(const VariableSystem::Aggregation aggregation) -> std::string {
+    for (const auto &[name, candidate]: AGGREGATION_NAMES) {
+        if (candidate == aggregation) {
+            return name;
+        }
+    }
+    return "sum";
+}
@@ -0,0 +1,26 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_GRAPHFILE_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_GRAPHFILE_HPP
+
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "VariableSystem.hpp"
+
+/// Text form of the definitions a VariableSystem is built from, one variable per line in id order:
+/// `primary`, or an optional aggregation (sum, min, max, count, avg) followed by inputs as `id` or `id*weight`.
+/// Blank lines and lines starting with `#` are ignored. Malformed input throws std::runtime_error.
+class GraphFile {
+public:
+    [[nodiscard]] static auto parse(std::istream &input) -> std::vector<VariableSystem::Definition>;
+
+    [[nodiscard]] static auto load(const std::string &path) -> std::vector<VariableSystem::Definition>;
+
+    [[nodiscard]] static auto aggregationName(VariableSystem::Aggregation aggregation) -> std::string;
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_GRAPHFILE_HPP
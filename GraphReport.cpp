@@ -0,0 +1,216 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "GraphFile.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <stack>
+#include <stdexcept>
+#include <vector>
+
+// Static analysis of a topology before it is deployed: shape distributions, closure sizes, which secondaries
+// are shared by many primaries, which primaries can conflict at all, and a per-primary contention prediction.
+//
+// The contention score of a primary p is the expected number of other updates it collides with when every
+// primary is updated equally often: sum over s in closure(p) of (sharers(s) - 1) / (P - 1), where sharers(s)
+// is the number of primaries whose closure contains s. It grows with both overlap and closure size (which is
+// also how long the locks are held), and a value >= 1 means p practically never runs alone.
+
+namespace {
+    constexpr size_t TOP_COUNT = 10;
+
+    /// Power-of-two buckets: [0], [1], [2, 3], [4, 7], ...
+    void printDistribution(const std::string &title, const std::vector<size_t> &samples) {
+        std::cout << title << '\n';
+        if (samples.empty()) {
+            std::cout << "  (none)\n";
+            return;
+        }
+        std::map<size_t, size_t> buckets;
+        for (const auto sample: samples) {
+            ++buckets[sample ? std::bit_floor(sample) : 0];
+        }
+        const auto total = std::accumulate(samples.cbegin(), samples.cend(), 0.0);
+        std::cout << "  mean " << total / static_cast<double>(samples.size())
+                  << ", max " << *std::max_element(samples.cbegin(), samples.cend()) << '\n';
+        for (const auto &[low, count]: buckets) {
+            const auto high = low ? 2 * low - 1 : 0;
+            std::cout << "  " << std::setw(8) << low << " - " << std::setw(8) << high << " : " << count << '\n';
+        }
+    }
+
+    class UnionFind {
+    private:
+        std::vector<size_t> parents;
+
+    public:
+        explicit UnionFind(const size_t size) : parents(size) {
+            std::iota(parents.begin(), parents.end(), 0);
+        }
+
+        auto find(size_t element) -> size_t {
+            while (parents[element] != element) {
+                element = parents[element] = parents[parents[element]];
+            }
+            return element;
+        }
+
+        void unite(const size_t lhs, const size_t rhs) {
+            parents[find(lhs)] = find(rhs);
+        }
+    };
+}
+
+auto main(int argc, char **argv) -> int {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <graph file>\n";
+        return 1;
+    }
+    std::vector<VariableSystem::Definition> definitions;
+    try {
+        definitions = GraphFile::load(argv[1]);
+    } catch (const std::runtime_error &error) {
+        std::cerr << argv[1] << ": " << error.what() << '\n';
+        return 1;
+    }
+    const auto size = definitions.size();
+    std::vector<std::vector<size_t>> dependents(size);
+    std::vector<size_t> fanIn(size), primaries, secondaryFanIn, secondaryIndex(size);
+    for (size_t id = 0; id < size; ++id) {
+        fanIn[id] = definitions[id].dependencies.size();
+        for (const auto &dependency: definitions[id].dependencies) {
+            dependents[dependency.id].push_back(id);
+        }
+        if (definitions[id].dependencies.empty()) {
+            primaries.push_back(id);
+        } else {
+            secondaryIndex[id] = secondaryFanIn.size();
+            secondaryFanIn.push_back(fanIn[id]);
+        }
+    }
+
+    // depth = longest path from a primary, computed in topological order
+    std::vector<size_t> remainingInputs(fanIn), order(primaries), depth(size, 0);
+    for (size_t next = 0; next < order.size(); ++next) {
+        for (const auto dependent: dependents[order[next]]) {
+            depth[dependent] = std::max(depth[dependent], depth[order[next]] + 1);
+            if (!--remainingInputs[dependent]) {
+                order.push_back(dependent);
+            }
+        }
+    }
+    if (order.size() != size) {
+        std::cerr << argv[1] << ": the dependencies form a cycle\n";
+        return 1;
+    }
+
+    std::vector<std::vector<size_t>> closures(primaries.size());
+    std::vector<size_t> sharers(size, 0), closureSizes;
+    std::vector<bool> visited(size, false);
+    for (size_t index = 0; index < primaries.size(); ++index) {
+        auto &closure = closures[index];
+        std::stack<size_t> stack;
+        stack.push(primaries[index]);
+        visited[primaries[index]] = true;
+        while (!stack.empty()) {
+            const auto current = stack.top();
+            stack.pop();
+            closure.push_back(current);
+            for (const auto dependent: dependents[current]) {
+                if (!visited[dependent]) {
+                    visited[dependent] = true;
+                    stack.push(dependent);
+                }
+            }
+        }
+        for (const auto id: closure) {
+            visited[id] = false;
+            ++sharers[id];
+        }
+        closureSizes.push_back(closure.size());
+    }
+
+    // primaries conflict when their closures share a variable; components are the groups that can ever contend
+    UnionFind components(primaries.size());
+    std::vector<size_t> firstSharer(size, SIZE_MAX);
+    for (size_t index = 0; index < primaries.size(); ++index) {
+        for (const auto id: closures[index]) {
+            if (firstSharer[id] == SIZE_MAX) {
+                firstSharer[id] = index;
+            } else {
+                components.unite(index, firstSharer[id]);
+            }
+        }
+    }
+    std::map<size_t, size_t> componentSizeByRoot;
+    for (size_t index = 0; index < primaries.size(); ++index) {
+        ++componentSizeByRoot[components.find(index)];
+    }
+    std::vector<size_t> componentSizes;
+    for (const auto &[_, componentSize]: componentSizeByRoot) {
+        componentSizes.push_back(componentSize);
+    }
+
+    std::vector<std::pair<double, size_t>> contention;
+    const auto otherPrimaries = static_cast<double>(std::max<size_t>(primaries.size(), 2) - 1);
+    for (size_t index = 0; index < primaries.size(); ++index) {
+        auto score = 0.0;
+        for (const auto id: closures[index]) {
+            score += static_cast<double>(sharers[id] - 1) / otherPrimaries;
+        }
+        contention.emplace_back(score, primaries[index]);
+    }
+
+    std::vector<size_t> depths, fanOut;
+    for (size_t id = 0; id < size; ++id) {
+        depths.push_back(depth[id]);
+        fanOut.push_back(dependents[id].size());
+    }
+    std::cout << "VARIABLES = " << size << ", PRIMARIES = " << primaries.size()
+              << ", SECONDARIES = " << size - primaries.size() << '\n';
+    // the default of the runtime option, so the report follows it
+    const auto splitFanIn = VariableSystem::Options{}.maxFanIn;
+    std::cout << "SECONDARIES ABOVE FAN-IN " << splitFanIn << " (split into hidden trees at runtime) = "
+              << std::count_if(secondaryFanIn.cbegin(), secondaryFanIn.cend(),
+                               [splitFanIn](size_t inputs) { return inputs > splitFanIn; }) << "\n\n";
+    printDistribution("DEPTH (longest path from a primary)", depths);
+    printDistribution("FAN-IN (inputs per secondary)", secondaryFanIn);
+    printDistribution("FAN-OUT (dependents per variable)", fanOut);
+    printDistribution("CLOSURE SIZE (variables locked per update)", closureSizes);
+    printDistribution("CONFLICT COMPONENT SIZE (primaries that can contend with each other)", componentSizes);
+
+    std::vector<std::pair<size_t, size_t>> shared;
+    for (size_t id = 0; id < size; ++id) {
+        if (!definitions[id].dependencies.empty()) {
+            shared.emplace_back(sharers[id], id);
+        }
+    }
+    const auto sharedCount = std::min(TOP_COUNT, shared.size());
+    std::partial_sort(shared.begin(), shared.begin() + static_cast<std::ptrdiff_t>(sharedCount), shared.end(),
+                      std::greater<>());
+    std::cout << "MOST SHARED SECONDARIES (primaries whose updates lock them)\n";
+    for (size_t rank = 0; rank < sharedCount; ++rank) {
+        std::cout << "  #" << shared[rank].second << " (" << GraphFile::aggregationName(
+                definitions[shared[rank].second].aggregation) << ", depth " << depth[shared[rank].second]
+                  << "): " << shared[rank].first << " / " << primaries.size() << '\n';
+    }
+
+    std::sort(contention.begin(), contention.end(), std::greater<>());
+    std::cout << "PREDICTED LOCK CONTENTION PER PRIMARY (expected colliding updates per update)\n";
+    for (const auto &[score, primary]: contention) {
+        std::cout << "  #" << primary << ": " << score << '\n';
+    }
+    const auto meanScore = std::accumulate(contention.cbegin(), contention.cend(), 0.0,
+                                           [](double sum, const auto &entry) { return sum + entry.first; }) /
+                           std::max<double>(static_cast<double>(contention.size()), 1);
+    std::cout << "MEAN CONTENTION SCORE = " << meanScore << '\n';
+    return 0;
+}
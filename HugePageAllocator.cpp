@@ -0,0 +1,99 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "HugePageAllocator.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <sys/mman.h>
+
+namespace {
+    std::atomic<bool> hugePagesEnabled{true};
+    std::atomic<size_t> explicitBytes{0};
+    std::atomic<size_t> transparentBytes{0};
+    std::atomic<size_t> regularBytes{0};
+
+    /// the counter each live mapping was added to, so deallocate subtracts from the same one; mappings are few and
+    /// large, so a locked map costs nothing next to the mmap call
+    std::mutex mappingsLock;
+    std::unordered_map<void *, std::atomic<size_t> *> mappingCounters;
+
+    auto track(void *mapping, std::atomic<size_t> &counter, const size_t bytes) -> void * {
+        counter.fetch_add(bytes, std::memory_order_relaxed);
+        const std::lock_guard lockGuard(mappingsLock);
+        mappingCounters.emplace(mapping, &counter);
+        return mapping;
+    }
+
+    auto roundUp(const size_t bytes) -> size_t {
+        return (bytes + HugePages::PAGE_SIZE - 1) / HugePages::PAGE_SIZE * HugePages::PAGE_SIZE;
+    }
+
+    auto mapAnonymous(const size_t bytes, const int extraFlags) -> void * {
+        void *mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+        return mapping == MAP_FAILED ? nullptr : mapping;
+    }
+
+    /// transparent huge pages only back 2 MB aligned ranges, so over-map and trim both ends
+    auto mapAligned(const size_t bytes) -> void * {
+        auto *mapping = static_cast<char *>(mapAnonymous(bytes + HugePages::PAGE_SIZE, 0));
+        if (!mapping) { return nullptr; }
+        const auto address = reinterpret_cast<uintptr_t>(mapping);
+        const auto aligned = (address + HugePages::PAGE_SIZE - 1) / HugePages::PAGE_SIZE * HugePages::PAGE_SIZE;
+        const auto head = aligned - address;
+        if (head) {
+            munmap(mapping, head);
+        }
+        if (HugePages::PAGE_SIZE - head) {
+            munmap(reinterpret_cast<char *>(aligned) + bytes, HugePages::PAGE_SIZE - head);
+        }
+        return reinterpret_cast<void *>(aligned);
+    }
+}
+
+/* static */ void HugePages::setEnabled(const bool enabled) {
+    hugePagesEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+/* static */ auto HugePages::enabled() -> bool {
+    return hugePagesEnabled.load(std::memory_order_relaxed);
+}
+
+/* static */ auto HugePages::allocate(const size_t bytes) -> void * {
+    const auto rounded = roundUp(bytes);
+    if (enabled()) {
+        if (auto *mapping = mapAnonymous(rounded, MAP_HUGETLB | (21 << MAP_HUGE_SHIFT))) {
+            return track(mapping, explicitBytes, rounded);
+        }
+        if (auto *mapping = mapAligned(rounded)) {
+            madvise(mapping, rounded, MADV_HUGEPAGE);
+            return track(mapping, transparentBytes, rounded);
+        }
+    } else if (auto *mapping = mapAnonymous(rounded, 0)) {
+        madvise(mapping, rounded, MADV_NOHUGEPAGE);
+        return track(mapping, regularBytes, rounded);
+    }
+    throw std::bad_alloc();
+}
+
+/* static */ void HugePages::deallocate(void *pointer, const size_t bytes) {
+    const auto rounded = roundUp(bytes);
+    {
+        const std::lock_guard lockGuard(mappingsLock);
+        const auto mapping = mappingCounters.find(pointer);
+        if (mapping != mappingCounters.end()) {
+            mapping->second->fetch_sub(rounded, std::memory_order_relaxed);
+            mappingCounters.erase(mapping);
+        }
+    }
+    munmap(pointer, rounded);
+}
+
+/* static */ auto HugePages::statistics() -> Statistics {
+    return {explicitBytes.load(std::memory_order_relaxed),
+            transparentBytes.load(std::memory_order_relaxed),
+            regularBytes.load(std::memory_order_relaxed)};
+}
@@ -0,0 +1,73 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_HUGEPAGEALLOCATOR_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_HUGEPAGEALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/// Backing store for large arrays: explicit 2 MB pages (MAP_HUGETLB) when the kernel has a pool of them,
+/// otherwise a 2 MB aligned mapping advised for transparent huge pages, otherwise plain pages.
+class HugePages {
+public:
+    static constexpr size_t PAGE_SIZE = size_t{2} << 20;
+    /// smaller allocations stay on the regular heap, a huge page would mostly be wasted on them
+    static constexpr size_t MIN_BYTES = size_t{1} << 20;
+
+    /// Bytes currently mapped by each kind of backing
+    struct Statistics {
+        size_t explicitBytes;
+        size_t transparentBytes;
+        size_t regularBytes;
+    };
+
+    /// Disabling makes later large allocations explicitly opt out of huge pages, for before / after comparisons
+    static void setEnabled(bool enabled);
+
+    [[nodiscard]] static auto enabled() -> bool;
+
+    [[nodiscard]] static auto allocate(size_t bytes) -> void *;
+
+    static void deallocate(void *pointer, size_t bytes);
+
+    [[nodiscard]] static auto statistics() -> Statistics;
+};
+
+template<typename T>
+class HugePageAllocator {
+public:
+    using value_type = T;
+
+    HugePageAllocator() = default;
+
+    template<typename U>
+    explicit(false) HugePageAllocator(const HugePageAllocator<U> &) noexcept {} // NOLINT(*-explicit-constructor)
+
+    [[nodiscard]] auto allocate(const size_t count) -> T * {
+        const auto bytes = count * sizeof(T);
+        if (bytes < HugePages::MIN_BYTES) {
+            return static_cast<T *>(::operator new(bytes, std::align_val_t{alignof(T)}));
+        }
+        return static_cast<T *>(HugePages::allocate(bytes));
+    }
+
+    void deallocate(T *pointer, const size_t count) noexcept {
+        const auto bytes = count * sizeof(T);
+        if (bytes < HugePages::MIN_BYTES) {
+            ::operator delete(pointer, std::align_val_t{alignof(T)});
+            return;
+        }
+        HugePages::deallocate(pointer, bytes);
+    }
+
+    template<typename U>
+    auto operator==(const HugePageAllocator<U> &) const noexcept -> bool { return true; }
+};
+
+template<typename T>
+using HugePageVector = std::vector<T, HugePageAllocator<T>>;
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_HUGEPAGEALLOCATOR_HPP
@@ -0,0 +1,63 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_LINKINTERNER_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_LINKINTERNER_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "HugePageAllocator.hpp"
+
+/// Hash-conses the links of lists of runs stored in one pool: a link {firstRank, length, <operand>, next} is
+/// interned by its contents including its successor, so lists built back to front share their equal tails. Operand
+/// names the link's third field, the run's weight or instruction word.
+template<typename Link, uint32_t Link::*Operand>
+class LinkInterner {
+public:
+    static constexpr uint32_t END = UINT32_MAX;
+
+private:
+    struct Hash {
+        auto operator()(const Link &link) const -> size_t {
+            return static_cast<size_t>(
+                    (static_cast<uint64_t>(link.firstRank) << 32 | link.length) * 0x9E3779B97F4A7C15ULL ^
+                    (static_cast<uint64_t>(link.*Operand) << 32 | link.next) * 0xC2B2AE3D27D4EB4FULL);
+        }
+    };
+
+    struct Equal {
+        auto operator()(const Link &lhs, const Link &rhs) const -> bool {
+            return lhs.firstRank == rhs.firstRank && lhs.length == rhs.length && lhs.*Operand == rhs.*Operand &&
+                   lhs.next == rhs.next;
+        }
+    };
+
+    HugePageVector<Link> &pool;
+    std::unordered_map<Link, uint32_t, Hash, Equal> indices;
+
+public:
+    explicit LinkInterner(HugePageVector<Link> &pool) : pool(pool) {}
+
+    /// The pool index of links, linked in order; the next fields they come with are ignored
+    [[nodiscard]] auto chain(const std::vector<Link> &links) -> uint32_t {
+        auto next = END;
+        for (auto link = links.rbegin(); link != links.rend(); ++link) {
+            auto linked = *link;
+            linked.next = next;
+            const auto [entry, added] = indices.try_emplace(linked, static_cast<uint32_t>(pool.size()));
+            if (added) {
+                assert(pool.size() < END && "Too many links for 32-bit indices");
+                pool.push_back(linked);
+            }
+            next = entry->second;
+        }
+        return next;
+    }
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_LINKINTERNER_HPP
@@ -0,0 +1,218 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    struct Description {
+        const char *name;
+        const char *help;
+    };
+
+    struct HistogramDescription {
+        const char *name;
+        const char *help;
+        uint64_t firstBound;
+        uint64_t growthFactor;
+        /// multiplier from the recorded unit to the exposed one
+        double scale;
+    };
+
+    constexpr std::array COUNTER_DESCRIPTIONS{
+            Description{"variable_system_updates_committed_total",
+                        "Primary updates whose whole closure has been applied"},
+            Description{"variable_system_reads_total", "Variable reads"},
+            Description{"variable_system_consistency_checks_total", "Completed consistency checks"},
+            Description{"variable_system_consistency_failures_total", "Secondaries found inconsistent by a check"},
+            Description{"variable_system_sampled_checks_total", "Completed sampling consistency checks"},
+            Description{"variable_system_sampled_secondaries_total", "Secondaries verified by sampling checks"},
+            Description{"variable_system_checksum_checks_total", "Consistency screenings by the linear checksum"},
+            Description{"variable_system_primary_sets_superseded_total",
+                        "New primary values replaced by a newer one before they were applied"},
+            Description{"variable_system_primary_sets_stale_total",
+                        "New primary values dropped for an out-of-date sequence number"},
+            Description{"variable_system_primaries_migrated_total",
+                        "Primaries moved to another worker by affinity rebalancing"},
+            Description{"variable_system_closure_cache_hits_total",
+                        "Updates whose closure was found in the bounded closure cache"},
+            Description{"variable_system_closure_cache_misses_total",
+                        "Updates whose closure had to be compiled by a traversal"},
+            Description{"variable_system_closure_cache_evictions_total",
+                        "Compiled closures evicted from the bounded closure cache"},
+    };
+
+    constexpr std::array GAUGE_DESCRIPTIONS{
+            Description{"variable_system_updates_waiting_for_locks", "Updates currently acquiring their closure locks"},
+            Description{"variable_system_pending_primary_sets", "New primary values accepted but not applied yet"},
+    };
+
+    constexpr std::array HISTOGRAM_DESCRIPTIONS{
+            HistogramDescription{"variable_system_closure_size", "Variables locked by one update", 1, 2, 1},
+            HistogramDescription{"variable_system_lock_wait_seconds",
+                                 "Time an update spent acquiring its closure locks", 1'000, 4, 1e-9},
+            HistogramDescription{"variable_system_update_latency_seconds",
+                                 "Time from the start of an update to its commit", 1'000, 4, 1e-9},
+            HistogramDescription{"variable_system_check_duration_seconds",
+                                 "Duration of a full consistency check", 1'000, 4, 1e-9},
+    };
+
+    /// the finite upper bounds of every histogram's buckets, so an observation is a binary search over a few words
+    constexpr auto BUCKET_BOUNDS = [] {
+        std::array<std::array<uint64_t, Metrics::BUCKET_COUNT - 1>, HISTOGRAM_DESCRIPTIONS.size()> bounds{};
+        for (size_t histogram = 0; histogram < bounds.size(); ++histogram) {
+            auto bound = HISTOGRAM_DESCRIPTIONS[histogram].firstBound;
+            for (auto &bucketBound: bounds[histogram]) {
+                bucketBound = bound;
+                bound *= HISTOGRAM_DESCRIPTIONS[histogram].growthFactor;
+            }
+        }
+        return bounds;
+    }();
+
+    std::atomic<size_t> nextShardIndex{0};
+}
+
+/* static */ auto Metrics::localShardIndex() -> size_t {
+    thread_local const auto index = nextShardIndex.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+    return index;
+}
+
+/* static */ auto Metrics::bucketBound(const Histogram histogram, const size_t bucket) -> uint64_t {
+    return BUCKET_BOUNDS[static_cast<size_t>(histogram)][bucket];
+}
+
+void Metrics::add(const Counter counter, const uint64_t amount) {
+    shards[localShardIndex()].counters[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void Metrics::adjust(const Gauge gauge, const int64_t amount) {
+    shards[localShardIndex()].gauges[static_cast<size_t>(gauge)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void Metrics::observe(const Histogram histogram, const uint64_t value) {
+    auto &shard = shards[localShardIndex()];
+    const auto index = static_cast<size_t>(histogram);
+    const auto &bounds = BUCKET_BOUNDS[index];
+    // the first bound at least the value; past the last finite one is the +Inf bucket
+    const auto bucket = static_cast<size_t>(std::lower_bound(bounds.cbegin(), bounds.cend(), value) - bounds.cbegin());
+    shard.buckets[index][bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.sums[index].fetch_add(value, std::memory_order_relaxed);
+}
+
+auto Metrics::total(const Counter counter) const -> uint64_t {
+    auto sum = uint64_t{0};
+    for (const auto &shard: shards) {
+        sum += shard.counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+auto Metrics::HistogramSnapshot::operator-(const HistogramSnapshot &earlier) const -> HistogramSnapshot {
+    HistogramSnapshot window;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        window.buckets[bucket] = buckets[bucket] - earlier.buckets[bucket];
+    }
+    window.sum = sum - earlier.sum;
+    window.count = count - earlier.count;
+    return window;
+}
+
+auto Metrics::snapshot(const Histogram histogram) const -> HistogramSnapshot {
+    const auto index = static_cast<size_t>(histogram);
+    HistogramSnapshot result;
+    for (const auto &shard: shards) {
+        for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+            result.buckets[bucket] += shard.buckets[index][bucket].load(std::memory_order_relaxed);
+        }
+        result.sum += shard.sums[index].load(std::memory_order_relaxed);
+    }
+    for (const auto bucketCount: result.buckets) {
+        result.count += bucketCount;
+    }
+    return result;
+}
+
+/* static */ auto Metrics::quantileUpperBound(const Histogram histogram,
+                                              const HistogramSnapshot &window,
+                                              const double quantile) -> uint64_t {
+    if (!window.count) { return 0; }
+    const auto rank = static_cast<uint64_t>(quantile * static_cast<double>(window.count - 1)) + 1;
+    auto cumulative = uint64_t{0};
+    for (size_t bucket = 0; bucket < BUCKET_COUNT - 1; ++bucket) {
+        cumulative += window.buckets[bucket];
+        if (cumulative >= rank) {
+            return bucketBound(histogram, bucket);
+        }
+    }
+    return UINT64_MAX;
+}
+
+auto Metrics::exposition() const -> std::string {
+    static_assert(COUNTER_DESCRIPTIONS.size() == COUNTER_COUNT);
+    static_assert(GAUGE_DESCRIPTIONS.size() == GAUGE_COUNT);
+    static_assert(HISTOGRAM_DESCRIPTIONS.size() == HISTOGRAM_COUNT);
+    std::ostringstream oss;
+    for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+        const auto &[name, help] = COUNTER_DESCRIPTIONS[counter];
+        oss << "# HELP " << name << ' ' << help << '\n'
+            << "# TYPE " << name << " counter\n"
+            << name << ' ' << total(static_cast<Counter>(counter)) << '\n';
+    }
+    for (size_t gauge = 0; gauge < GAUGE_COUNT; ++gauge) {
+        const auto &[name, help] = GAUGE_DESCRIPTIONS[gauge];
+        auto sum = int64_t{0};
+        for (const auto &shard: shards) {
+            sum += shard.gauges[gauge].load(std::memory_order_relaxed);
+        }
+        oss << "# HELP " << name << ' ' << help << '\n'
+            << "# TYPE " << name << " gauge\n"
+            << name << ' ' << sum << '\n';
+    }
+    for (size_t histogram = 0; histogram < HISTOGRAM_COUNT; ++histogram) {
+        const auto &description = HISTOGRAM_DESCRIPTIONS[histogram];
+        oss << "# HELP " << description.name << ' ' << description.help << '\n'
+            << "# TYPE " << description.name << " histogram\n";
+        auto cumulative = uint64_t{0};
+        for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+            for (const auto &shard: shards) {
+                cumulative += shard.buckets[histogram][bucket].load(std::memory_order_relaxed);
+            }
+            oss << description.name << "_bucket{le=\"";
+            if (bucket == BUCKET_COUNT - 1) {
+                oss << "+Inf";
+            } else {
+                oss << static_cast<double>(bucketBound(static_cast<Histogram>(histogram), bucket)) * description.scale;
+            }
+            oss << "\"} " << cumulative << '\n';
+        }
+        auto sum = uint64_t{0};
+        for (const auto &shard: shards) {
+            sum += shard.sums[histogram].load(std::memory_order_relaxed);
+        }
+        oss << description.name << "_sum " << static_cast<double>(sum) * description.scale << '\n'
+            << description.name << "_count " << cumulative << '\n';
+    }
+    return oss.str();
+}
+
+void Metrics::exportTo(const std::string &path) const {
+    const auto temporaryPath = path + ".tmp";
+    std::error_code error;
+    {
+        std::ofstream file(temporaryPath, std::ios::trunc);
+        file << exposition();
+        file.close();
+        // a short write must not replace the last complete exposition
+        if (!file) {
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporaryPath, path, error);
+}
@@ -0,0 +1,100 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_METRICS_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/// Counters, gauges and histograms sharded per thread, so recording never contends;
+/// shards are only summed when the metrics are exposed in Prometheus text format.
+class Metrics {
+public:
+    enum class Counter : size_t {
+        UpdatesCommitted,
+        Reads,
+        ConsistencyChecks,
+        ConsistencyFailures,
+        SampledChecks,
+        SampledSecondaries,
+        ChecksumChecks,
+        PrimarySetsSuperseded,
+        PrimarySetsStale,
+        PrimariesMigrated,
+        ClosureCacheHits,
+        ClosureCacheMisses,
+        ClosureCacheEvictions,
+        COUNT,
+    };
+
+    enum class Gauge : size_t {
+        UpdatesWaitingForLocks,
+        PendingPrimarySets,
+        COUNT,
+    };
+
+    enum class Histogram : size_t {
+        ClosureSize,
+        LockWaitNanoseconds,
+        UpdateLatencyNanoseconds,
+        CheckNanoseconds,
+        COUNT,
+    };
+
+    static constexpr size_t BUCKET_COUNT = 16;
+
+    /// Non-cumulative bucket counts of a histogram at one point in time; subtract two to get a window
+    struct HistogramSnapshot {
+        std::array<uint64_t, BUCKET_COUNT> buckets{};
+        uint64_t sum = 0;
+        uint64_t count = 0;
+
+        [[nodiscard]] auto operator-(const HistogramSnapshot &earlier) const -> HistogramSnapshot;
+    };
+
+private:
+    static constexpr size_t SHARD_COUNT = 64;
+    static constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+    static constexpr size_t GAUGE_COUNT = static_cast<size_t>(Gauge::COUNT);
+    static constexpr size_t HISTOGRAM_COUNT = static_cast<size_t>(Histogram::COUNT);
+
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+        std::array<std::atomic<int64_t>, GAUGE_COUNT> gauges{};
+        std::array<std::array<std::atomic<uint64_t>, BUCKET_COUNT>, HISTOGRAM_COUNT> buckets{};
+        std::array<std::atomic<uint64_t>, HISTOGRAM_COUNT> sums{};
+    };
+
+    std::array<Shard, SHARD_COUNT> shards{};
+
+    [[nodiscard]] static auto localShardIndex() -> size_t;
+
+    [[nodiscard]] static auto bucketBound(Histogram histogram, size_t bucket) -> uint64_t;
+
+public:
+    void add(Counter counter, uint64_t amount = 1);
+
+    void adjust(Gauge gauge, int64_t amount);
+
+    void observe(Histogram histogram, uint64_t value);
+
+    [[nodiscard]] auto total(Counter counter) const -> uint64_t;
+
+    [[nodiscard]] auto snapshot(Histogram histogram) const -> HistogramSnapshot;
+
+    /// The upper bound of the bucket holding the q-quantile, or 0 for an empty window
+    [[nodiscard]] static auto
+    quantileUpperBound(Histogram histogram, const HistogramSnapshot &window, double quantile) -> uint64_t;
+
+    [[nodiscard]] auto exposition() const -> std::string;
+
+    /// Replaces the file atomically, so a scraper never sees a partial exposition; a failed write leaves the previous
+    /// file in place
+    void exportTo(const std::string &path) const;
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_METRICS_HPP
@@ -0,0 +1,112 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "Numa.hpp"
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    constexpr int MAX_NODES = 1024;
+    constexpr size_t MASK_BITS = sizeof(unsigned long) * CHAR_BIT;
+
+    using NodeMask = std::array<unsigned long, MAX_NODES / MASK_BITS>;
+
+    /// sysfs cpu lists look like `0-3,8-11`
+    auto parseCpuList(const std::string &list) -> std::vector<int> {
+        std::vector<int> cpus;
+        std::istringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            const auto dash = range.find('-');
+            try {
+                const auto first = std::stoi(range.substr(0, dash));
+                const auto last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (auto cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            } catch (const std::logic_error &) {
+                break;
+            }
+        }
+        return cpus;
+    }
+
+    auto nodeCpuList(const int node) -> std::vector<int> {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!file || !std::getline(file, list)) { return {}; }
+        return parseCpuList(list);
+    }
+
+    auto applyPolicy(void *address, const size_t bytes, const int mode, const NodeMask &nodes) -> bool {
+        return syscall(SYS_mbind, address, bytes, mode, nodes.data(), MAX_NODES, MPOL_MF_MOVE) == 0;
+    }
+}
+
+/* static */ auto Numa::cpus() -> std::vector<Cpu> {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) { return {}; }
+    std::vector<Cpu> result;
+    std::vector<bool> placed(CPU_SETSIZE, false);
+    // node directories may have gaps (offline nodes), so probe a few past the last one found
+    for (int node = 0, missing = 0; node < MAX_NODES && missing < 8; ++node) {
+        const auto nodeCpus = nodeCpuList(node);
+        missing = nodeCpus.empty() ? missing + 1 : 0;
+        for (const auto cpu: nodeCpus) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed) && !placed[cpu]) {
+                placed[cpu] = true;
+                result.push_back({cpu, node});
+            }
+        }
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && !placed[cpu]) {
+            result.push_back({cpu, 0});
+        }
+    }
+    std::stable_sort(result.begin(), result.end(), [](const Cpu &lhs, const Cpu &rhs) { return lhs.node < rhs.node; });
+    return result;
+}
+
+/* static */ auto Numa::nodeCount() -> int {
+    const auto allowed = cpus();
+    return allowed.empty() ? 1 : std::max_element(allowed.cbegin(), allowed.cend(), [](const Cpu &lhs, const Cpu &rhs) {
+        return lhs.node < rhs.node;
+    })->node + 1;
+}
+
+/* static */ auto Numa::pinCurrentThread(const int cpu) -> bool {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+/* static */ auto Numa::bind(void *address, const size_t bytes, const int node) -> bool {
+    if (node < 0 || node >= MAX_NODES) { return false; }
+    NodeMask nodes{};
+    nodes[node / MASK_BITS] |= 1UL << (node % MASK_BITS);
+    return applyPolicy(address, bytes, MPOL_BIND, nodes);
+}
+
+/* static */ auto Numa::interleave(void *address, const size_t bytes) -> bool {
+    NodeMask nodes{};
+    for (int node = 0; node < nodeCount(); ++node) {
+        nodes[node / MASK_BITS] |= 1UL << (node % MASK_BITS);
+    }
+    return applyPolicy(address, bytes, MPOL_INTERLEAVE, nodes);
+}
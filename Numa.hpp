@@ -0,0 +1,35 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_NUMA_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_NUMA_HPP
+
+#include <cstddef>
+#include <vector>
+
+/// CPU and memory topology of the machine, read from sysfs, plus thread pinning and page placement.
+/// Without sysfs node information every allowed CPU is reported on node 0.
+class Numa {
+public:
+    struct Cpu {
+        int id;
+        int node;
+    };
+
+    /// The CPUs this process may run on, grouped by node
+    [[nodiscard]] static auto cpus() -> std::vector<Cpu>;
+
+    [[nodiscard]] static auto nodeCount() -> int;
+
+    static auto pinCurrentThread(int cpu) -> bool;
+
+    /// Binds [address, address + bytes) to node and migrates the pages already faulted in; address must be page
+    /// aligned. Fails, leaving the pages where they are, when the kernel or sandbox does not allow it
+    static auto bind(void *address, size_t bytes, int node) -> bool;
+
+    /// Like bind, but spreads the pages round-robin over every node
+    static auto interleave(void *address, size_t bytes) -> bool;
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_NUMA_HPP
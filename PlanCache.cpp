@@ -0,0 +1,155 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "PlanCache.hpp"
+
+#include <bit>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t ALIGNMENT = 8;
+
+    auto padded(const size_t size) -> size_t {
+        return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+}
+
+void PlanCache::Hasher::add(const uint64_t word) {
+    state = std::rotl((state ^ word) * MULTIPLIER, 29);
+}
+
+void PlanCache::Hasher::add(const uint8_t *bytes, const size_t count) {
+    size_t offset = 0;
+    for (; offset + sizeof(uint64_t) <= count; offset += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + offset, sizeof(word));
+        add(word);
+    }
+    uint64_t tail = count;
+    std::memcpy(&tail, bytes + offset, count - offset);
+    add(tail);
+}
+
+auto PlanCache::Hasher::value() const -> uint64_t {
+    // final avalanche, so every input bit affects every output bit
+    auto result = state;
+    result ^= result >> 33;
+    result *= 0xFF51AFD7ED558CCDULL;
+    result ^= result >> 33;
+    result *= 0xC4CEB9FE1A85EC53ULL;
+    result ^= result >> 33;
+    return result;
+}
+
+void PlanCache::Writer::append(const void *data, const size_t size) {
+    const auto offset = bytes.size();
+    bytes.resize(offset + padded(size), 0);
+    if (size) {
+        std::memcpy(bytes.data() + offset, data, size);
+    }
+}
+
+void PlanCache::Reader::take(void *data, const size_t size) {
+    assert(padded(size) <= static_cast<size_t>(end - cursor) && "Plan cache section read past its end");
+    if (size) {
+        std::memcpy(data, cursor, size);
+    }
+    cursor += padded(size);
+}
+
+PlanCache::PlanCache(PlanCache &&other) noexcept: mapping(other.mapping), mappingBytes(other.mappingBytes) {
+    other.mapping = nullptr;
+    other.mappingBytes = 0;
+}
+
+PlanCache::~PlanCache() {
+    if (mapping) {
+        munmap(const_cast<uint8_t *>(mapping), mappingBytes);
+    }
+}
+
+/* static */ auto PlanCache::open(const std::string &path, const uint64_t key) -> std::optional<PlanCache> {
+    const auto descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return std::nullopt;
+    }
+    struct stat status{};
+    const auto size = fstat(descriptor, &status) ? 0 : static_cast<size_t>(status.st_size);
+    void *address = size >= sizeof(Header) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0) : MAP_FAILED;
+    close(descriptor);
+    if (address == MAP_FAILED) {
+        return std::nullopt;
+    }
+    // the checksum reads the whole mapping right away
+    madvise(address, size, MADV_WILLNEED);
+    PlanCache cache(static_cast<const uint8_t *>(address), size);
+    Header header{};
+    std::memcpy(&header, cache.mapping, sizeof(header));
+    if (header.magic != MAGIC || header.version != FORMAT_VERSION || header.key != key ||
+        header.payloadBytes != size - sizeof(Header) ||
+        header.payloadBytes < header.sectionCount * sizeof(SectionEntry)) {
+        return std::nullopt;
+    }
+    Hasher checksum;
+    checksum.add(cache.mapping + sizeof(Header), header.payloadBytes);
+    if (checksum.value() != header.checksum) {
+        return std::nullopt;
+    }
+    for (size_t index = 0; index < header.sectionCount; ++index) {
+        SectionEntry entry{};
+        std::memcpy(&entry, cache.mapping + sizeof(Header) + index * sizeof(SectionEntry), sizeof(entry));
+        if (entry.offset > header.payloadBytes || entry.bytes > header.payloadBytes - entry.offset) {
+            return std::nullopt;
+        }
+    }
+    return cache;
+}
+
+/* static */ auto
+PlanCache::save(const std::string &path, const uint64_t key, const std::vector<Writer> &sections) -> bool {
+    Writer payload;
+    auto offset = sections.size() * sizeof(SectionEntry);
+    for (const auto &section: sections) {
+        const SectionEntry entry{offset, section.bytes.size()};
+        payload.append(&entry, sizeof(entry));
+        offset += section.bytes.size();
+    }
+    for (const auto &section: sections) {
+        payload.append(section.bytes.data(), section.bytes.size());
+    }
+    Hasher checksum;
+    checksum.add(payload.bytes.data(), payload.bytes.size());
+    const Header header{MAGIC, FORMAT_VERSION, static_cast<uint32_t>(sections.size()), key, payload.bytes.size(),
+                        checksum.value()};
+    const auto temporaryPath = path + ".tmp";
+    auto *file = std::fopen(temporaryPath.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const auto written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                         std::fwrite(payload.bytes.data(), 1, payload.bytes.size(), file) == payload.bytes.size();
+    if (std::fclose(file) || !written) {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+auto PlanCache::sectionCount() const -> size_t {
+    Header header{};
+    std::memcpy(&header, mapping, sizeof(header));
+    return header.sectionCount;
+}
+
+auto PlanCache::section(const size_t index) const -> Reader {
+    assert(index < sectionCount() && "Plan cache section out of range");
+    SectionEntry entry{};
+    std::memcpy(&entry, mapping + sizeof(Header) + index * sizeof(SectionEntry), sizeof(entry));
+    const auto *begin = mapping + sizeof(Header) + entry.offset;
+    return {begin, begin + entry.bytes};
+}
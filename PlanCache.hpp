@@ -0,0 +1,131 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_PLANCACHE_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_PLANCACHE_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "HugePageAllocator.hpp"
+
+/// Structures derived from a graph, saved to a file so that the next start with the same graph maps them instead
+/// of recomputing them. The file is a header (magic, format version, the key of the graph, payload size and
+/// checksum), a table of sections and the sections themselves; a section is a sequence of arrays, each its
+/// element count followed by the elements padded to 8 bytes. Everything is in native byte order: it is a cache,
+/// not an exchange format, and any mismatch simply makes it a miss.
+class PlanCache {
+public:
+    /// 64-bit hash consuming whole words, for the graph keys and the payload checksum
+    class Hasher {
+    private:
+        static constexpr uint64_t MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+
+        uint64_t state;
+
+    public:
+        explicit Hasher(uint64_t seed = 0) : state(seed ^ MULTIPLIER) {}
+
+        void add(uint64_t word);
+
+        void add(const uint8_t *bytes, size_t count);
+
+        [[nodiscard]] auto value() const -> uint64_t;
+    };
+
+    /// Builds one section in memory
+    class Writer {
+    private:
+        std::vector<uint8_t> bytes;
+
+        friend class PlanCache;
+
+    public:
+        template<typename T, typename Allocator>
+        void write(const std::vector<T, Allocator> &array) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            const uint64_t count = array.size();
+            append(&count, sizeof(count));
+            append(array.data(), count * sizeof(T));
+        }
+
+    private:
+        void append(const void *data, size_t size);
+    };
+
+    /// Reads the arrays of one section back, in the order they were written
+    class Reader {
+    private:
+        const uint8_t *cursor;
+        const uint8_t *end;
+
+    public:
+        Reader(const uint8_t *cursor, const uint8_t *end) : cursor(cursor), end(end) {}
+
+        template<typename T, typename Allocator>
+        void read(std::vector<T, Allocator> &array) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            uint64_t count = 0;
+            take(&count, sizeof(count));
+            array.resize(count);
+            take(array.data(), count * sizeof(T));
+        }
+
+    private:
+        void take(void *data, size_t size);
+    };
+
+private:
+    static constexpr uint64_t MAGIC = 0x534E414C50313042ULL;
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t sectionCount;
+        uint64_t key;
+        uint64_t payloadBytes;
+        uint64_t checksum;
+    };
+
+    /// offset from the start of the payload, which begins with the section table
+    struct SectionEntry {
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    const uint8_t *mapping = nullptr;
+    size_t mappingBytes = 0;
+
+    PlanCache(const uint8_t *mapping, size_t mappingBytes) : mapping(mapping), mappingBytes(mappingBytes) {}
+
+public:
+    PlanCache(const PlanCache &) = delete;
+
+    PlanCache(PlanCache &&other) noexcept;
+
+    auto operator=(const PlanCache &) -> PlanCache & = delete;
+
+    auto operator=(PlanCache &&other) = delete;
+
+    ~PlanCache();
+
+    /// Maps the file; empty if it is missing, unreadable, of another format version, for another key or corrupt
+    [[nodiscard]] static auto open(const std::string &path, uint64_t key) -> std::optional<PlanCache>;
+
+    /// Replaces the file atomically, so a concurrent or interrupted start never maps half a file
+    static auto save(const std::string &path, uint64_t key, const std::vector<Writer> &sections) -> bool;
+
+    [[nodiscard]] auto sectionCount() const -> size_t;
+
+    [[nodiscard]] auto section(size_t index) const -> Reader;
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_PLANCACHE_HPP
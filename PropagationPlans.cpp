@@ -0,0 +1,63 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "PropagationPlans.hpp"
+
+#include <cassert>
+#include <unordered_map>
+
+#include "LinkInterner.hpp"
+
+PropagationPlans::PropagationPlans(const SharedRunAdjacency &closures, const std::vector<bool> &linear) {
+    LinkInterner<Instruction, &Instruction::operand> interned(code);
+    std::unordered_map<double, uint32_t> constantIndices;
+    lockHeads.reserve(closures.size());
+    applyHeads.reserve(closures.size());
+    std::vector<Instruction> locks;
+    std::vector<Instruction> applies;
+    for (size_t primary = 0; primary < closures.size(); ++primary) {
+        locks.clear();
+        applies.clear();
+        for (const auto &[firstRank, length, weight]: closures[primary].runs()) {
+            // runs only split by a change of weight are one run for locking
+            if (!locks.empty() && locks.back().firstRank + locks.back().length == firstRank) {
+                locks.back().length += length;
+            } else {
+                locks.push_back({firstRank, length, static_cast<uint32_t>(Opcode::Lock) << OPCODE_SHIFT, END});
+            }
+            if (linear[primary]) {
+                const auto [constant, added] = constantIndices.try_emplace(weight, constants.size());
+                if (added) {
+                    assert(constants.size() <= CONSTANT_MASK && "Too many distinct weights for the constant pool");
+                    constants.push_back(weight);
+                }
+                applies.push_back({firstRank, length,
+                                   static_cast<uint32_t>(Opcode::Apply) << OPCODE_SHIFT | constant->second, END});
+            }
+        }
+        lockHeads.push_back(interned.chain(locks));
+        applyHeads.push_back(interned.chain(applies));
+    }
+    code.shrink_to_fit();
+    constants.shrink_to_fit();
+}
+
+PropagationPlans::PropagationPlans(PlanCache::Reader &&reader) {
+    reader.read(lockHeads);
+    reader.read(applyHeads);
+    reader.read(code);
+    reader.read(constants);
+}
+
+void PropagationPlans::save(PlanCache::Writer &writer) const {
+    writer.write(lockHeads);
+    writer.write(applyHeads);
+    writer.write(code);
+    writer.write(constants);
+}
+
+auto PropagationPlans::memoryUsage() const -> size_t {
+    return (lockHeads.capacity() + applyHeads.capacity()) * sizeof(uint32_t) +
+           code.capacity() * sizeof(Instruction) + constants.capacity() * sizeof(double);
+}
@@ -0,0 +1,153 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_PROPAGATIONPLANS_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_PROPAGATIONPLANS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "Adjacency.hpp"
+#include "HugePageAllocator.hpp"
+#include "PlanCache.hpp"
+
+/// Every primary's update compiled into one shared arena of 16-byte instructions, each over a run of consecutive
+/// ranks of its closure and linked to the next: a chain that locks the closure in rank order, and a chain that
+/// applies the delta times each run's path-summed weight. Unlocking walks the lock chain again. Like the closures,
+/// chains ending in the same instructions share that tail. The weights live in a deduplicated constant pool,
+/// which for the usual handful of distinct weights stays in L1. Plans of non-linear closures have no apply chain,
+/// since their deltas depend on values.
+class PropagationPlans {
+public:
+    enum class Opcode : uint32_t {
+        Lock,
+        Apply,
+    };
+
+    static constexpr uint32_t OPCODE_SHIFT = 30;
+    static constexpr uint32_t CONSTANT_MASK = (1U << OPCODE_SHIFT) - 1;
+    static constexpr uint32_t END = UINT32_MAX;
+
+    struct Instruction {
+        VariableId firstRank;
+        uint32_t length;
+        /// the opcode in the top bits, the constant pool index of an apply's multiplier in the others
+        uint32_t operand;
+        uint32_t next;
+
+        [[nodiscard]] auto opcode() const -> Opcode { return static_cast<Opcode>(operand >> OPCODE_SHIFT); }
+
+        [[nodiscard]] auto constant() const -> uint32_t { return operand & CONSTANT_MASK; }
+    };
+
+    class Chain {
+    public:
+        class Iterator {
+        private:
+            const Instruction *code = nullptr;
+            uint32_t index = END;
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Instruction;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Instruction *;
+            using reference = const Instruction &;
+
+            Iterator() = default;
+
+            Iterator(const Instruction *code, const uint32_t index) : code(code), index(index) {}
+
+            auto operator*() const -> const Instruction & { return code[index]; }
+
+            auto operator++() -> Iterator & {
+                index = code[index].next;
+                return *this;
+            }
+
+            auto operator==(const Iterator &other) const -> bool { return index == other.index; }
+        };
+
+    private:
+        const Instruction *code;
+        uint32_t head;
+
+    public:
+        Chain(const Instruction *code, uint32_t head) : code(code), head(head) {}
+
+        [[nodiscard]] auto begin() const -> Iterator { return {code, head}; }
+
+        [[nodiscard]] auto end() const -> Iterator { return {code, END}; }
+    };
+
+    /// Walks the ranks of a chain one at a time across its instructions; runs ahead of the loops over the runs so
+    /// what they touch a few ranks later is prefetched, whether or not it is in the same run
+    class RankCursor {
+    private:
+        Chain::Iterator instruction;
+        Chain::Iterator end;
+        uint32_t offset = 0;
+
+    public:
+        RankCursor(const Chain &chain, const size_t distance) : instruction(chain.begin()), end(chain.end()) {
+            for (size_t step = 0; step < distance && !done(); ++step) {
+                advance();
+            }
+        }
+
+        [[nodiscard]] auto done() const -> bool { return instruction == end; }
+
+        [[nodiscard]] auto rank() const -> VariableId { return (*instruction).firstRank + offset; }
+
+        void advance() {
+            if (++offset == (*instruction).length) {
+                ++instruction;
+                offset = 0;
+            }
+        }
+    };
+
+    class Plan {
+    private:
+        const Instruction *code;
+        uint32_t lockHead;
+        uint32_t applyHead;
+
+    public:
+        Plan(const Instruction *code, uint32_t lockHead, uint32_t applyHead)
+                : code(code), lockHead(lockHead), applyHead(applyHead) {}
+
+        [[nodiscard]] auto locks() const -> Chain { return {code, lockHead}; }
+
+        [[nodiscard]] auto applies() const -> Chain { return {code, applyHead}; }
+    };
+
+private:
+    HugePageVector<uint32_t> lockHeads;
+    HugePageVector<uint32_t> applyHeads;
+    HugePageVector<Instruction> code;
+    HugePageVector<double> constants;
+
+public:
+    PropagationPlans() = default;
+
+    /// linear[p] tells whether primary p's deltas are its closure's weights times its own
+    PropagationPlans(const SharedRunAdjacency &closures, const std::vector<bool> &linear);
+
+    explicit PropagationPlans(PlanCache::Reader &&reader);
+
+    void save(PlanCache::Writer &writer) const;
+
+    [[nodiscard]] auto operator[](const size_t primary) const -> Plan {
+        return {code.data(), lockHeads[primary], applyHeads[primary]};
+    }
+
+    [[nodiscard]] auto multiplier(const Instruction &apply) const -> double { return constants[apply.constant()]; }
+
+    [[nodiscard]] auto memoryUsage() const -> size_t;
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_PROPAGATIONPLANS_HPP
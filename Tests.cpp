@@ -0,0 +1,772 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "ExampleTopology.hpp"
+#include "GraphFile.hpp"
+#include "VariableSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Checks run by ctest, one per process: `Lab01_Tests <check>` from the source directory, or every check when no
+// name is given. Each builds a system, lets its simulated workload run, then sets primaries through the public API
+// and compares every visible variable as read by readVariable with the value recomputed from the definitions, and
+// runs a full consistency check.
+
+class VariableSystemTests {
+private:
+    using Definition = VariableSystem::Definition;
+    using Value = VariableSystem::Value;
+
+    static constexpr uint64_t SEED = 42;
+    static constexpr Value RELATIVE_TOLERANCE = 1e-9;
+
+    static inline auto failures = 0;
+    /// above every sequence number the workload hands out, so the checks' sets are never stale
+    static inline uint64_t nextSequence = uint64_t{1} << 32;
+
+    static void expect(const bool condition, const std::string &what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << '\n';
+            ++failures;
+        }
+    }
+
+    [[nodiscard]] static auto simulated(const PropagationMode propagation) -> VariableSystem::Options {
+        VariableSystem::Options options;
+        options.propagation = propagation;
+        options.seed = SEED;
+        options.clock = std::make_shared<VirtualClock>(SEED);
+        return options;
+    }
+
+    [[nodiscard]] static auto load(const std::string &path) -> std::vector<Definition> {
+        return GraphFile::load(path);
+    }
+
+    /// Every variable recomputed from the primaries' values by the definitions alone
+    [[nodiscard]] static auto evaluate(const std::vector<Definition> &definitions,
+                                       const std::vector<Value> &primaryValues) -> std::vector<Value> {
+        std::vector<Value> values(definitions.size());
+        std::vector<bool> known(definitions.size(), false);
+        const std::function<Value(size_t)> valueOf = [&](const size_t id) -> Value {
+            if (known[id]) {
+                return values[id];
+            }
+            const auto &[aggregation, dependencies] = definitions[id];
+            auto value = primaryValues[id];
+            if (!dependencies.empty()) {
+                std::vector<Value> terms;
+                auto totalWeight = Value{0};
+                for (const auto &[dep, weight]: dependencies) {
+                    terms.push_back(weight * valueOf(dep));
+                    totalWeight += weight;
+                }
+                switch (aggregation) {
+                    case VariableSystem::Aggregation::Sum:
+                        value = std::accumulate(terms.cbegin(), terms.cend(), Value{0});
+                        break;
+                    case VariableSystem::Aggregation::Average:
+                        value = std::accumulate(terms.cbegin(), terms.cend(), Value{0}) / totalWeight;
+                        break;
+                    case VariableSystem::Aggregation::Min:
+                        value = *std::min_element(terms.cbegin(), terms.cend());
+                        break;
+                    case VariableSystem::Aggregation::Max:
+                        value = *std::max_element(terms.cbegin(), terms.cend());
+                        break;
+                    case VariableSystem::Aggregation::CountNonZero:
+                        value = static_cast<Value>(std::count_if(terms.cbegin(), terms.cend(),
+                                                                 [](const Value term) { return term != 0; }));
+                        break;
+                }
+            }
+            known[id] = true;
+            return values[id] = value;
+        };
+        for (size_t id = 0; id < definitions.size(); ++id) {
+            [[maybe_unused]] const auto value = valueOf(id);
+        }
+        return values;
+    }
+
+    /// Every visible variable read through readVariable matches its recomputation, and a full check passes
+    static void expectConsistent(VariableSystem &system, const std::vector<Definition> &definitions,
+                                 const std::string &context) {
+        std::vector<Value> read(definitions.size());
+        for (size_t id = 0; id < definitions.size(); ++id) {
+            read[id] = system.readVariable(id);
+        }
+        const auto expected = evaluate(definitions, read);
+        for (size_t id = 0; id < definitions.size(); ++id) {
+            expect(std::abs(read[id] - expected[id]) <=
+                   RELATIVE_TOLERANCE * std::max({Value{1}, std::abs(read[id]), std::abs(expected[id])}),
+                   context + ": variable " + std::to_string(id) + " reads " + std::to_string(read[id]) +
+                   ", expected " + std::to_string(expected[id]));
+        }
+        const auto failuresBefore = system.metrics.total(Metrics::Counter::ConsistencyFailures);
+        system.checkConsistency();
+        expect(system.metrics.total(Metrics::Counter::ConsistencyFailures) == failuresBefore,
+               context + ": the consistency check failed");
+    }
+
+    static void set(VariableSystem &system, const size_t primaryID, const Value value) {
+        expect(system.setPrimary(primaryID, value, nextSequence++) == VariableSystem::SetOutcome::Applied,
+               "setting primary " + std::to_string(primaryID) + " was not applied");
+    }
+
+    /// Sets every primary a few times, checking after each round
+    static void expectConsistentUpdates(VariableSystem &system, const std::vector<Definition> &definitions,
+                                        const std::string &context) {
+        expectConsistent(system, definitions, context + " after the workload");
+        for (auto round = 1; round <= 3; ++round) {
+            for (size_t id = 0; id < definitions.size(); ++id) {
+                if (definitions[id].dependencies.empty()) {
+                    set(system, id, static_cast<Value>((id * 7 + round * 13) % 23) - 11);
+                }
+            }
+            expectConsistent(system, definitions, context + " after round " + std::to_string(round));
+        }
+    }
+
+    static void checkPropagation(const PropagationMode propagation, const std::string &context) {
+        const auto definitions = load("graphs/example.graph");
+        auto copy = definitions;
+        VariableSystem system(std::move(copy), simulated(propagation));
+        expectConsistentUpdates(system, definitions, context);
+    }
+
+    /// With a closure cache a third the size of every closure together, updates keep missing, compiling closures
+    /// by a traversal and evicting others, and the budget still holds
+    static void checkPropagationWithClosureCache(const PropagationMode propagation, const std::string &context) {
+        constexpr size_t UNBOUNDED_BYTES = size_t{1} << 30;
+        const auto definitions = load("graphs/example.graph");
+        auto options = simulated(propagation);
+        options.closureCacheBytes = UNBOUNDED_BYTES;
+        auto copy = definitions;
+        const VariableSystem probe(std::move(copy), options);
+        const auto everyClosureBytes = probe.closureCache->memoryUsage();
+
+        options = simulated(propagation);
+        options.closureCacheBytes = everyClosureBytes / 3;
+        copy = definitions;
+        VariableSystem system(std::move(copy), options);
+        expectConsistentUpdates(system, definitions, context);
+        expect(system.metrics.total(Metrics::Counter::ClosureCacheMisses) > 0 &&
+               system.metrics.total(Metrics::Counter::ClosureCacheEvictions) > 0,
+               context + ": a cache smaller than the closures neither missed nor evicted");
+        expect(system.closureCache->memoryUsage() <= options.closureCacheBytes,
+               context + ": the closure cache holds more than its budget");
+    }
+
+    /// Secondaries summing, averaging, taking the minimum of and counting many weighted primaries, and a sum over
+    /// the first two
+    [[nodiscard]] static auto wideFanIn(const size_t primaryCount) -> std::vector<Definition> {
+        std::vector<Definition> definitions(primaryCount);
+        Definition sum;
+        Definition average{VariableSystem::Aggregation::Average, {}};
+        for (size_t id = 0; id < primaryCount; ++id) {
+            sum.dependencies.push_back({id, static_cast<Value>(1 + id % 3)});
+            average.dependencies.push_back({id, static_cast<Value>(1 + id % 2)});
+        }
+        Definition minimum{VariableSystem::Aggregation::Min, sum.dependencies};
+        Definition count{VariableSystem::Aggregation::CountNonZero, average.dependencies};
+        definitions.push_back(sum);
+        definitions.push_back(average);
+        definitions.push_back(minimum);
+        definitions.push_back(count);
+        definitions.push_back({VariableSystem::Aggregation::Sum, {{primaryCount, 1}, {primaryCount + 1, 2}, {0, 1}}});
+        return definitions;
+    }
+
+    static void checkFanIn(const PropagationMode propagation, const std::string &context) {
+        constexpr size_t PRIMARY_COUNT = 100;
+        constexpr size_t MAX_FAN_IN = 8;
+        const auto definitions = wideFanIn(PRIMARY_COUNT);
+        auto options = simulated(propagation);
+        options.maxFanIn = MAX_FAN_IN;
+        auto copy = definitions;
+        VariableSystem system(std::move(copy), options);
+        // 100 inputs take ceil(100 / 8) = 13 hidden aggregations, which take 2 more, for each wide secondary
+        expect(system.size - system.visibleSize == 4 * (13 + 2),
+               context + ": " + std::to_string(system.size - system.visibleSize) + " hidden aggregation variables");
+        expectConsistentUpdates(system, definitions, context);
+    }
+
+    struct Step {
+        size_t primaryID;
+        Value value;
+    };
+
+    /// On graphs/aggregates.graph: duplicate minima, then removals of the current min and max of 6, 7 and 10
+    [[nodiscard]] static auto aggregateSteps() -> std::vector<Step> {
+        return {{0, 5}, {1, 5}, {2, 9}, {3, 0}, {4, 2}, {5, 7},
+                {0, 8} /* one of two minima of 6 leaves */, {1, 10} /* the other one too */,
+                {2, 1} /* the maximum of 7 leaves, and 6's minimum drops */, {2, 20} /* and comes back */,
+                {5, -3} /* 10's minimum changes input */, {5, 30}, {3, 4} /* 8 counts one more input */,
+                {0, 0}, {1, 0}, {2, 0}};
+    }
+
+    static void runSteps(VariableSystem &system, const std::vector<Definition> &definitions,
+                         const std::vector<Step> &steps, const std::string &context) {
+        for (size_t index = 0; index < steps.size(); ++index) {
+            set(system, steps[index].primaryID, steps[index].value);
+            expectConsistent(system, definitions, context + " after step " + std::to_string(index));
+        }
+    }
+
+public:
+    static void checkAggregations() {
+        const auto definitions = load("graphs/aggregates.graph");
+        for (const auto propagation: {PropagationMode::Eager, PropagationMode::Lazy}) {
+            const auto context = std::string("aggregates, ") +
+                                 (propagation == PropagationMode::Eager ? "eager" : "lazy");
+            auto copy = definitions;
+            VariableSystem system(std::move(copy), simulated(propagation));
+            expectConsistent(system, definitions, context + " after the workload");
+            runSteps(system, definitions, aggregateSteps(), context);
+        }
+    }
+
+    /// Adaptive mode: writes without reads turn the secondaries lazy, the min / max inputs change meanwhile, then
+    /// reads turn them eager again, which rebuilds their input multisets before the next removals
+    static void checkLazyToEagerSwitch() {
+        constexpr auto WRITE_ROUNDS = 200;
+        constexpr auto READ_ROUNDS = 2000;
+        constexpr size_t MIN_OF_PRIMARIES = 6;
+        const auto definitions = load("graphs/aggregates.graph");
+        auto copy = definitions;
+        VariableSystem system(std::move(copy), simulated(PropagationMode::Adaptive));
+        for (auto round = 0; round < WRITE_ROUNDS; ++round) {
+            for (size_t id = 0; id < 6; ++id) {
+                set(system, id, static_cast<Value>((round * 5 + id * 3) % 17));
+            }
+        }
+        system.adaptPropagation();
+        expect(system.lazy[MIN_OF_PRIMARIES].load(), "min secondary did not turn lazy after writes without reads");
+        runSteps(system, definitions, {{0, 5}, {1, 5}, {2, 9}, {3, 0}, {4, 2}, {5, 7}}, "while lazy");
+        for (auto round = 0; round < READ_ROUNDS; ++round) {
+            for (size_t id = 6; id < definitions.size(); ++id) {
+                [[maybe_unused]] const auto value = system.readVariable(id);
+            }
+        }
+        system.adaptPropagation();
+        expect(!system.lazy[MIN_OF_PRIMARIES].load(), "min secondary did not turn eager after reads");
+        runSteps(system, definitions, aggregateSteps(), "after turning eager");
+    }
+
+    /// ExampleTopology, compiled from graphs/example.graph by the TopologyCompiler, follows the same primaries
+    /// through its straight-line updates as the system does through its propagation
+    static void checkCompiledTopology() {
+        const auto definitions = load("graphs/example.graph");
+        expect(definitions.size() == ExampleTopology::VARIABLE_COUNT,
+               "ExampleTopology was compiled from another graph");
+        auto copy = definitions;
+        VariableSystem system(std::move(copy), simulated(PropagationMode::Eager));
+        std::vector<Value> compiled(ExampleTopology::VARIABLE_COUNT);
+        for (size_t id = 0; id < compiled.size(); ++id) {
+            compiled[id] = system.readVariable(id);
+        }
+        expect(ExampleTopology::checkConsistency(compiled.data()), "compiled check fails after the workload");
+        const auto locks = std::make_unique<VariableLock[]>(ExampleTopology::VARIABLE_COUNT);
+        for (auto round = 1; round <= 3; ++round) {
+            for (size_t id = 0; id < compiled.size(); ++id) {
+                if (!definitions[id].dependencies.empty()) { continue; }
+                const auto value = static_cast<Value>((id * 5 + round * 11) % 19) - 9;
+                ExampleTopology::updateVariable(id, compiled.data(), locks.get(), value - compiled[id]);
+                set(system, id, value);
+            }
+            const auto context = "compiled topology after round " + std::to_string(round);
+            for (size_t id = 0; id < compiled.size(); ++id) {
+                const auto read = system.readVariable(id);
+                expect(std::abs(read - compiled[id]) <=
+                       RELATIVE_TOLERANCE * std::max({Value{1}, std::abs(read), std::abs(compiled[id])}),
+                       context + ": variable " + std::to_string(id) + " reads " + std::to_string(read) +
+                       ", compiled " + std::to_string(compiled[id]));
+            }
+            expect(ExampleTopology::checkConsistency(compiled.data()), context + ": the compiled check fails");
+            expectConsistent(system, definitions, context);
+        }
+    }
+
+    /// Without affinity any worker may set any primary, so sets race: while one call holds a primary's lock to
+    /// apply a value, the sets behind it are queued, the newest one wins and the older ones are dropped
+    static void checkCoalescing() {
+        constexpr size_t PRIMARY_ID = 0;
+        const auto definitions = load("graphs/example.graph");
+        auto options = simulated(PropagationMode::Eager);
+        options.affinity = false;
+        auto copy = definitions;
+        VariableSystem system(std::move(copy), options);
+        expectConsistent(system, definitions, "coalescing after the workload");
+        const auto supersededBefore = system.metrics.total(Metrics::Counter::PrimarySetsSuperseded);
+        const auto staleBefore = system.metrics.total(Metrics::Counter::PrimarySetsStale);
+        const auto first = nextSequence;
+        nextSequence += 4;
+        // the drainer blocks inside its update until the primary's lock is released
+        std::unique_lock held(system.locks[PRIMARY_ID]);
+        auto drainerOutcome = VariableSystem::SetOutcome::Stale;
+        std::jthread drainer([&] { drainerOutcome = system.setPrimary(PRIMARY_ID, 1, first); });
+        for (auto draining = false; !draining; std::this_thread::yield()) {
+            const std::lock_guard lockGuard(system.mailboxes[PRIMARY_ID].lock);
+            draining = system.mailboxes[PRIMARY_ID].draining;
+        }
+        expect(system.setPrimary(PRIMARY_ID, 2, first + 1) == VariableSystem::SetOutcome::Queued,
+               "a set behind a drainer was not queued");
+        expect(system.setPrimary(PRIMARY_ID, 3, first + 3) == VariableSystem::SetOutcome::Queued,
+               "a newer set behind a drainer was not queued");
+        expect(system.setPrimary(PRIMARY_ID, 4, first + 2) == VariableSystem::SetOutcome::Stale,
+               "a set overtaken by a newer one was not dropped");
+        held.unlock();
+        drainer.join();
+        expect(drainerOutcome == VariableSystem::SetOutcome::Applied, "the drainer did not apply the sets");
+        expect(system.readVariable(PRIMARY_ID) == 3, "the newest set was not the one left applied");
+        expect(system.metrics.total(Metrics::Counter::PrimarySetsSuperseded) == supersededBefore + 1,
+               "the superseded set was not counted");
+        expect(system.metrics.total(Metrics::Counter::PrimarySetsStale) == staleBefore + 1,
+               "the stale set was not counted");
+        expectConsistent(system, definitions, "coalescing after the queued sets");
+    }
+
+    /// A history keeping one to two complete segments per primary drops the older ones as values keep coming, and
+    /// still reconstructs the present
+    static void checkHistoryRetention() {
+        constexpr size_t PRIMARY_ID = 0;
+        constexpr auto SET_COUNT = 1000;
+        const auto definitions = load("graphs/example.graph");
+        auto options = simulated(PropagationMode::Eager);
+        options.history = true;
+        options.historyCheckpoints = 1;
+        auto copy = definitions;
+        VariableSystem system(std::move(copy), options);
+        for (auto index = 0; index < SET_COUNT; ++index) {
+            set(system, PRIMARY_ID, static_cast<Value>(index % 7));
+        }
+        const auto retained = system.histories[PRIMARY_ID].size();
+        expect(retained > ValueHistory::CHECKPOINT_INTERVAL && retained < 3 * ValueHistory::CHECKPOINT_INTERVAL,
+               "history retention kept " + std::to_string(retained) + " values");
+        const auto now = system.clock->now();
+        for (size_t id = 0; id < definitions.size(); ++id) {
+            const auto live = system.readVariable(id);
+            expect(system.valueAt(id, now) == live, "the history does not reconstruct variable " +
+                                                   std::to_string(id) + " after dropping segments");
+        }
+        expectConsistent(system, definitions, "history retention");
+    }
+
+    /// Writers and readers hammering one lock: writers bump a plain pair of counters with a yield in between, so
+    /// parked readers and writers, the writer-queued bit, the reader bias and its revocations all come into play,
+    /// and a reader seeing the two counters differ would be inside a writer's critical section
+    static void checkLockContention() {
+        constexpr auto THREAD_COUNT = 4;
+        constexpr uint64_t ITERATIONS = 20'000;
+        constexpr uint64_t YIELD_PERIOD = 64;
+        VariableLock lock;
+        uint64_t first = 0;
+        uint64_t second = 0;
+        std::atomic<uint64_t> tornReads{0};
+        {
+            std::vector<std::jthread> threads;
+            for (auto thread = 0; thread < THREAD_COUNT; ++thread) {
+                threads.emplace_back([&] {
+                    for (uint64_t i = 0; i < ITERATIONS; ++i) {
+                        const std::lock_guard lockGuard(lock);
+                        ++first;
+                        if (i % YIELD_PERIOD == 0) {
+                            std::this_thread::yield();
+                        }
+                        ++second;
+                    }
+                });
+                threads.emplace_back([&] {
+                    for (uint64_t i = 0; i < ITERATIONS; ++i) {
+                        // every fourth read only tries, and takes the lock properly when that fails
+                        std::shared_lock lockGuard(lock, std::defer_lock);
+                        if (i % 4 || !lockGuard.try_lock()) {
+                            lockGuard.lock();
+                        }
+                        if (first != second) {
+                            tornReads.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                });
+            }
+        }
+        expect(!tornReads.load(), std::to_string(tornReads.load()) + " reads saw a write half done");
+        expect(first == THREAD_COUNT * ITERATIONS && second == first, "writes were lost: " +
+                                                                       std::to_string(first) + " / " +
+                                                                       std::to_string(second));
+        expect((lock.state.load() & ~VariableLock::BIAS & ~VariableLock::STREAK_MASK) == 0,
+               "the lock is not free after the threads are done");
+    }
+
+    /// Tries failing against each kind of holder, and a reader bias revoked by a writer, then inhibited
+    static void checkLockBias() {
+        constexpr auto STREAK_READS = 32;
+        VariableLock lock;
+        lock.lock();
+        expect(!lock.try_lock(), "try_lock succeeded on a lock held exclusively");
+        expect(!lock.try_lock_shared(), "try_lock_shared succeeded on a lock held exclusively");
+        lock.unlock();
+        lock.lock_shared();
+        expect(!lock.try_lock(), "try_lock succeeded on a lock held shared");
+        expect(lock.try_lock_shared(), "try_lock_shared failed on a lock held shared");
+        lock.unlock_shared();
+        lock.unlock_shared();
+
+        for (auto read = 0; read < STREAK_READS; ++read) {
+            const std::shared_lock lockGuard(lock);
+        }
+        expect(lock.state.load() & VariableLock::BIAS, "a run of reads did not make the lock reader-biased");
+        lock.lock_shared();
+        expect(!(lock.state.load() & VariableLock::READER_MASK), "a biased read was counted in the lock word");
+        // the writer revokes the bias, then has to wait for the published reader
+        std::atomic<bool> written{false};
+        std::jthread writer([&] {
+            const std::lock_guard lockGuard(lock);
+            written.store(true);
+        });
+        while (!(lock.state.load() & VariableLock::WRITER)) {
+            std::this_thread::yield();
+        }
+        expect(!(lock.state.load() & VariableLock::BIAS), "the writer did not revoke the bias");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        expect(!written.load(), "the writer got in past a biased reader");
+        lock.unlock_shared();
+        writer.join();
+        expect(written.load(), "the writer did not get in after the biased reader left");
+
+        // the revocation just now inhibits the bias for a while, so another run of reads stays counted
+        for (auto read = 0; read < STREAK_READS; ++read) {
+            const std::shared_lock lockGuard(lock);
+        }
+        expect(!(lock.state.load() & VariableLock::BIAS), "the bias came back right after a revocation");
+
+        // a writer waiting behind a reader queues, and new readers then wait behind it
+        lock.lock_shared();
+        std::jthread queued([&] {
+            const std::lock_guard lockGuard(lock);
+        });
+        while (!(lock.state.load() & VariableLock::WRITER_QUEUED)) {
+            std::this_thread::yield();
+        }
+        expect(!lock.try_lock_shared(), "a new reader got in ahead of a queued writer");
+        lock.unlock_shared();
+        queued.join();
+        expect(lock.try_lock_shared(), "readers were still held back after the queued writer was done");
+        lock.unlock_shared();
+    }
+
+    /// BoundedCache on its own, with byte sizes chosen by hand
+    static void checkBoundedCache() {
+        using Cache = BoundedCache<VariableId, VariableId>;
+        const auto value = [](const VariableId key) { return std::make_shared<const VariableId>(key); };
+        {
+            // keys 0, 16, 32 and 48 share the first shard, since an integer hashes to itself
+            Cache cache(3);
+            for (const VariableId key: {0, 16, 32}) {
+                [[maybe_unused]] const auto insertion = cache.insert(key, value(key), 1);
+            }
+            expect(cache.find(0) != nullptr, "an entry inserted within the budget is missing");
+            const auto insertion = cache.insert(48, value(48), 1);
+            expect(insertion.evictions == 1, "one insertion over the budget evicted " +
+                                             std::to_string(insertion.evictions) + " entries");
+            expect(cache.find(0) != nullptr, "a referenced entry did not get a second chance");
+            expect(cache.find(16) == nullptr, "the unreferenced entry next to the hand was not the one evicted");
+            expect(cache.find(32) != nullptr && cache.find(48) != nullptr, "the wrong entries were evicted");
+        }
+        {
+            // the inserting key's shard is empty, so the victim comes from another one
+            Cache cache(2);
+            for (const VariableId key: {0, 1, 2}) {
+                [[maybe_unused]] const auto insertion = cache.insert(key, value(key), 1);
+            }
+            expect(cache.find(2) != nullptr && cache.entryCount() == 2 && cache.memoryUsage() == 2,
+                   "an insertion into an empty shard did not evict from another shard");
+        }
+        {
+            Cache cache(10);
+            const auto oversized = value(7);
+            const auto insertion = cache.insert(7, oversized, 11);
+            expect(insertion.value == oversized && cache.find(7) == nullptr && cache.memoryUsage() == 0,
+                   "a value larger than the whole budget was cached");
+        }
+        {
+            // threads inserting overlapping keys of different sizes: the budget holds throughout, and once they
+            // are done the bytes counted are exactly those of the entries cached, duplicates refunded
+            constexpr size_t CAPACITY = 64;
+            constexpr VariableId KEY_COUNT = 256;
+            constexpr auto THREAD_COUNT = 4;
+            constexpr VariableId INSERTIONS = 20'000;
+            const auto bytesOf = [](const VariableId key) { return size_t{1} + key % 8; };
+            Cache cache(CAPACITY);
+            std::atomic<size_t> overBudget{0};
+            std::atomic<size_t> wrongValues{0};
+            {
+                std::vector<std::jthread> threads;
+                for (auto thread = 0; thread < THREAD_COUNT; ++thread) {
+                    threads.emplace_back([&, thread] {
+                        for (VariableId i = 0; i < INSERTIONS; ++i) {
+                            const auto key = (i * 7 + thread * 13) % KEY_COUNT;
+                            const auto insertion = cache.insert(key, value(key), bytesOf(key));
+                            wrongValues.fetch_add(*insertion.value != key, std::memory_order_relaxed);
+                            overBudget.fetch_add(cache.memoryUsage() > CAPACITY, std::memory_order_relaxed);
+                        }
+                    });
+                }
+            }
+            expect(!overBudget.load(), "the cache went over its budget " + std::to_string(overBudget.load()) +
+                                       " times");
+            expect(!wrongValues.load(), "insertions returned another key's value");
+            size_t cachedBytes = 0;
+            for (VariableId key = 0; key < KEY_COUNT; ++key) {
+                cachedBytes += cache.find(key) ? bytesOf(key) : 0;
+            }
+            expect(cachedBytes == cache.memoryUsage(), "the cache counts " + std::to_string(cache.memoryUsage()) +
+                                                       " bytes for " + std::to_string(cachedBytes) +
+                                                       " bytes of entries");
+        }
+    }
+
+    static void checkClosureCache() {
+        checkBoundedCache();
+        checkPropagationWithClosureCache(PropagationMode::Eager, "closure cache, eager");
+        checkPropagationWithClosureCache(PropagationMode::Lazy, "closure cache, lazy");
+    }
+
+    /// A chain's instructions as {first rank, length, operand, multiplier}, the multiplier only for applies
+    [[nodiscard]] static auto instructions(const PropagationPlans &plans, const PropagationPlans::Chain &chain)
+            -> std::vector<std::tuple<VariableId, uint32_t, uint32_t, double>> {
+        std::vector<std::tuple<VariableId, uint32_t, uint32_t, double>> result;
+        for (const auto &instruction: chain) {
+            const auto apply = instruction.opcode() == PropagationPlans::Opcode::Apply;
+            result.emplace_back(instruction.firstRank, instruction.length, instruction.operand,
+                                apply ? plans.multiplier(instruction) : 0.0);
+        }
+        return result;
+    }
+
+    /// The derived structures a plan cache holds, compared between a system that saved them and one that loaded them
+    static void expectSameStructures(const VariableSystem &saved, const VariableSystem &loaded) {
+        expect(std::equal(saved.topologicalOrder.cbegin(), saved.topologicalOrder.cend(),
+                          loaded.topologicalOrder.cbegin(), loaded.topologicalOrder.cend()),
+               "the topological order loaded from the plan cache differs");
+        expect(std::equal(saved.ranks.cbegin(), saved.ranks.cend(), loaded.ranks.cbegin(), loaded.ranks.cend()),
+               "the ranks loaded from the plan cache differ");
+        for (const auto primary: saved.primaries) {
+            const auto savedRuns = saved.closures[primary].runs();
+            const auto loadedRuns = loaded.closures[primary].runs();
+            expect(std::equal(savedRuns.cbegin(), savedRuns.cend(), loadedRuns.cbegin(), loadedRuns.cend(),
+                              [](const SharedRunAdjacency::Run &lhs, const SharedRunAdjacency::Run &rhs) {
+                                  return lhs.firstRank == rhs.firstRank && lhs.length == rhs.length &&
+                                         lhs.weight == rhs.weight;
+                              }),
+                   "the closure of primary " + std::to_string(primary) + " loaded from the plan cache differs");
+            const auto savedPlan = saved.plans[primary];
+            const auto loadedPlan = loaded.plans[primary];
+            expect(instructions(saved.plans, savedPlan.locks()) == instructions(loaded.plans, loadedPlan.locks()) &&
+                   instructions(saved.plans, savedPlan.applies()) ==
+                   instructions(loaded.plans, loadedPlan.applies()),
+                   "the plan of primary " + std::to_string(primary) + " loaded from the plan cache differs");
+        }
+    }
+
+    /// A system started from a plan cache has the structures of the one that saved it; a flipped byte in the
+    /// file or another graph makes the cache a miss
+    static void checkPlanCache() {
+        const auto path = (std::filesystem::temp_directory_path() / "Lab01_Tests.plan-cache").string();
+        std::filesystem::remove(path);
+        const auto definitions = load("graphs/example.graph");
+        auto options = simulated(PropagationMode::Eager);
+        options.planCachePath = path;
+        auto copy = definitions;
+        const VariableSystem saved(std::move(copy), options);
+        expect(std::filesystem::exists(path), "a first start did not save the plan cache");
+        expect(saved.openPlanCache().has_value(), "the plan cache just saved is a miss");
+
+        copy = definitions;
+        VariableSystem loaded(std::move(copy), options);
+        expectSameStructures(saved, loaded);
+        expectConsistentUpdates(loaded, definitions, "plan cache, loaded");
+
+        const VariableSystem other(load("graphs/aggregates.graph"), simulated(PropagationMode::Eager));
+        expect(!PlanCache::open(path, other.computeGraphKey()).has_value(), "another graph's key hits the plan cache");
+
+        std::vector<char> bytes;
+        {
+            std::ifstream file(path, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        // the header is a few dozen bytes, so the middle of the file is payload
+        bytes[bytes.size() / 2] ^= 1;
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        }
+        expect(!saved.openPlanCache().has_value(), "a plan cache with a flipped payload byte is a hit");
+        copy = definitions;
+        const VariableSystem rebuilt(std::move(copy), options);
+        expect(rebuilt.openPlanCache().has_value(), "a start over a corrupt plan cache did not save a new one");
+        expectSameStructures(saved, rebuilt);
+        std::filesystem::remove(path);
+    }
+
+    /// The checksum screen on graphs/aggregates.graph: only secondaries linear in the primaries get a coefficient,
+    /// it passes on a consistent system and fails once such a secondary is corrupted, with no update in flight
+    static void checkChecksum() {
+        constexpr size_t LINEAR_SECONDARY = 9;
+        constexpr size_t NONLINEAR_SECONDARY = 12;
+        constexpr Value CORRUPTION = 1;
+        const auto definitions = load("graphs/aggregates.graph");
+        auto options = simulated(PropagationMode::Eager);
+        options.checksum = true;
+        auto copy = definitions;
+        VariableSystem system(std::move(copy), options);
+        std::vector<bool> linear(definitions.size());
+        for (size_t id = 0; id < definitions.size(); ++id) {
+            const auto &[aggregation, dependencies] = definitions[id];
+            linear[id] = (aggregation == VariableSystem::Aggregation::Sum ||
+                          aggregation == VariableSystem::Aggregation::Average) &&
+                         std::all_of(dependencies.cbegin(), dependencies.cend(), [&](const auto &dep) {
+                             return definitions[dep.id].dependencies.empty() || linear[dep.id];
+                         });
+            expect((system.checksumCoefficients[id] != 0) == (linear[id] && !dependencies.empty()),
+                   "variable " + std::to_string(id) + " has checksum coefficient " +
+                   std::to_string(system.checksumCoefficients[id]));
+        }
+        expect(linear[LINEAR_SECONDARY] && !linear[NONLINEAR_SECONDARY], "graphs/aggregates.graph has changed");
+        expect(system.verifyChecksum(), "the checksum fails after a clean run");
+        runSteps(system, definitions, aggregateSteps(), "checksum");
+        expect(system.verifyChecksum(), "the checksum fails after the updates");
+
+        // an update records the change it actually wrote, so a wrong write moves the running sum away from the one
+        // the primaries imply; a value changed behind the updates' back is left to the full checks
+        const auto write = [&](const size_t id, const Value change) {
+            system.variables[id] += change;
+            const auto checksumChange = system.checksumCoefficients[id] * change;
+            system.recordChecksumChange(checksumChange, std::abs(checksumChange));
+        };
+        write(LINEAR_SECONDARY, CORRUPTION);
+        expect(!system.verifyChecksum(), "the checksum passes with a linear secondary corrupted");
+        write(LINEAR_SECONDARY, -CORRUPTION);
+        expect(system.verifyChecksum(), "the checksum fails once the corruption is undone");
+
+        // a nonlinear secondary has coefficient 0, so it is left to sampling and the full checks
+        write(NONLINEAR_SECONDARY, CORRUPTION);
+        expect(system.verifyChecksum(), "the checksum covers a nonlinear secondary");
+        write(NONLINEAR_SECONDARY, -CORRUPTION);
+        expectConsistent(system, definitions, "checksum after the corruptions");
+        expect(system.verifyChecksum(), "the checksum fails after a full check rebased it");
+    }
+
+    static void checkSampling() {
+        constexpr size_t CORRUPTED_SECONDARY = 9;
+        constexpr Value CORRUPTION = 1;
+        const auto definitions = load("graphs/aggregates.graph");
+        const auto withConfidence = [&](const double confidence, const std::chrono::milliseconds fullCheckInterval) {
+            auto options = simulated(PropagationMode::Eager);
+            options.checkConfidence = confidence;
+            options.fullCheckInterval = fullCheckInterval;
+            auto copy = definitions;
+            return std::make_unique<VariableSystem>(std::move(copy), options);
+        };
+        // k of S secondaries per tick, interval / (CC_MAX_SLEEP_TIME_MS / 2) ticks: 1 - (1 - k / S)^ticks >= confidence
+        for (const auto &[confidence, interval, sampleSize]: {std::tuple{0.0, 100, size_t{0}},
+                                                              std::tuple{0.9, 200, size_t{2}},
+                                                              std::tuple{0.99, 100, size_t{5}},
+                                                              std::tuple{0.999, 50, size_t{7}}}) {
+            const auto system = withConfidence(confidence, std::chrono::milliseconds(interval));
+            expect(system->secondaries.size() == 7, "graphs/aggregates.graph has changed");
+            expect(system->checkSampleSize == sampleSize,
+                   "confidence " + std::to_string(confidence) + " over " + std::to_string(interval) + "ms samples " +
+                   std::to_string(system->checkSampleSize) + " secondaries instead of " + std::to_string(sampleSize));
+        }
+
+        constexpr auto CONFIDENCE = 0.99;
+        constexpr auto INTERVAL = std::chrono::milliseconds(100);
+        constexpr uint64_t TICKS = INTERVAL.count() / (VariableSystem::CC_MAX_SLEEP_TIME_MS / 2);
+        const auto system = withConfidence(CONFIDENCE, INTERVAL);
+        expect(system->detectionProbability(TICKS) >= CONFIDENCE, "the sample size falls short of the confidence");
+        runSteps(*system, definitions, aggregateSteps(), "sampling");
+        for (uint64_t tick = 0; tick < TICKS; ++tick) {
+            expect(system->sampleConsistency(), "sampling fails on a consistent system");
+        }
+        expect(system->samplingTicksSinceFullCheck == TICKS, "sampling ticks are not counted");
+
+        system->variables[CORRUPTED_SECONDARY] += CORRUPTION;
+        auto ticks = uint64_t{0};
+        auto detected = false;
+        while (!detected && ticks < TICKS) {
+            detected = !system->sampleConsistency();
+            ++ticks;
+        }
+        expect(detected, "sampling missed a corrupted secondary for " + std::to_string(TICKS) + " ticks");
+        system->variables[CORRUPTED_SECONDARY] -= CORRUPTION;
+        expectConsistent(*system, definitions, "sampling after the corruption");
+        expect(system->samplingTicksSinceFullCheck == 0, "a full check does not restart the sampling ticks");
+    }
+
+    static void checkLazyPropagation() {
+        checkPropagation(PropagationMode::Lazy, "lazy");
+    }
+
+    static void checkAdaptivePropagation() {
+        checkPropagation(PropagationMode::Adaptive, "adaptive");
+    }
+
+    static void checkFanInSplitting() {
+        checkFanIn(PropagationMode::Eager, "fan-in, eager");
+        checkFanIn(PropagationMode::Lazy, "fan-in, lazy");
+    }
+
+    static auto run(const std::string &name) -> int {
+        const std::map<std::string, std::function<void()>> checks{
+                {"lazy",              checkLazyPropagation},
+                {"adaptive",          checkAdaptivePropagation},
+                {"fan-in",            checkFanInSplitting},
+                {"aggregates",        checkAggregations},
+                {"lazy-to-eager",     checkLazyToEagerSwitch},
+                {"compiled-topology", checkCompiledTopology},
+                {"coalescing",        checkCoalescing},
+                {"history-retention", checkHistoryRetention},
+                {"lock-contention",   checkLockContention},
+                {"lock-bias",         checkLockBias},
+                {"closure-cache",     checkClosureCache},
+                {"plan-cache",        checkPlanCache},
+                {"checksum",          checkChecksum},
+                {"sampling",          checkSampling},
+        };
+        if (name.empty()) {
+            for (const auto &[_, check]: checks) {
+                check();
+            }
+        } else if (const auto check = checks.find(name); check != checks.end()) {
+            check->second();
+        } else {
+            std::cerr << "Unknown check " << name << '\n';
+            return 1;
+        }
+        return failures ? 1 : 0;
+    }
+};
+
+auto main(int argc, char **argv) -> int {
+    return VariableSystemTests::run(argc > 1 ? argv[1] : "");
+}
@@ -0,0 +1,59 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_TOPOLOGICALORDER_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_TOPOLOGICALORDER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stack>
+#include <utility>
+#include <vector>
+
+#include "Adjacency.hpp"
+
+/// The topological order lock ranks come from, shared by VariableSystem and the TopologyCompiler so both lock
+/// a graph's closures in the same order
+class TopologicalOrder {
+public:
+    /// Reverse post-order of a depth-first search from every primary, in id order, following each variable's
+    /// dependents in their stored order: whatever a primary reaches first ends up in one block of ranks right after
+    /// it, so closures become a few runs of consecutive ranks. Empty when the dependencies form a cycle. Dependents
+    /// is indexed by variable and yields rows of Edge; isPrimary tells the roots
+    template<typename Order, typename Dependents, typename IsPrimary>
+    [[nodiscard]] static auto compute(const size_t size, const Dependents &dependents, IsPrimary isPrimary) -> Order {
+        enum class State : uint8_t { Unvisited, OnStack, Done };
+        std::vector<State> states(size, State::Unvisited);
+        std::stack<std::pair<VariableId, size_t>> stack;
+        Order order;
+        order.reserve(size);
+        for (VariableId root = 0; root < size; ++root) {
+            if (!isPrimary(root) || states[root] != State::Unvisited) { continue; }
+            states[root] = State::OnStack;
+            stack.emplace(root, 0);
+            while (!stack.empty()) {
+                auto &[current, nextEdge] = stack.top();
+                if (nextEdge == dependents[current].size()) {
+                    states[current] = State::Done;
+                    order.push_back(current);
+                    stack.pop();
+                    continue;
+                }
+                const auto next = dependents[current][nextEdge++].id;
+                if (states[next] == State::OnStack) {
+                    return {};
+                }
+                if (states[next] == State::Unvisited) {
+                    states[next] = State::OnStack;
+                    stack.emplace(next, 0);
+                }
+            }
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_TOPOLOGICALORDER_HPP
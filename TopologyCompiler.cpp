@@ -0,0 +1,240 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "GraphFile.hpp"
+#include "TopologicalOrder.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Ahead-of-time compilation of a fixed topology: reads a graph file and writes a class <name> into
+// <name>.hpp / <name>.cpp with, per primary, a straight-line update taking its closure's locks in topological
+// rank order and adding the path-summed weight times delta to every variable, and a consistency check whose
+// sums are fixed expressions over the variable array. Nothing is interpreted at runtime, whatever the graph size.
+//
+// Straight-line updates need every aggregation on the way to be linear, so only sum and avg are accepted.
+
+namespace {
+    using Definition = VariableSystem::Definition;
+    using Aggregation = VariableSystem::Aggregation;
+
+    /// A weight as a C++ literal that reads back as the same double
+    auto literal(const double value) -> std::string {
+        std::ostringstream oss;
+        oss << std::setprecision(17) << value;
+        auto text = oss.str();
+        if (text.find_first_of(".e") == std::string::npos) {
+            text += ".0";
+        }
+        return text;
+    }
+
+    /// `weight * term`, or just the term for a weight of 1
+    auto weighted(const double weight, const std::string &term) -> std::string {
+        return weight == 1 ? term : literal(weight) + " * " + term;
+    }
+
+    auto variable(const size_t id) -> std::string {
+        return "variables[" + std::to_string(id) + "]";
+    }
+
+    /// Averages become sums with the weights normalised to 1, as VariableSystem::restructure does
+    auto normaliseAverages(std::vector<Definition> definitions) -> std::vector<Definition> {
+        for (auto &[aggregation, dependencies]: definitions) {
+            if (aggregation != Aggregation::Average) { continue; }
+            const auto totalWeight = std::accumulate(dependencies.cbegin(), dependencies.cend(), 0.0,
+                                                     [](double partialSum, const auto &dep) {
+                                                         return partialSum + dep.weight;
+                                                     });
+            if (totalWeight == 0) {
+                throw std::runtime_error("average over inputs whose weights sum to zero");
+            }
+            for (auto &dep: dependencies) {
+                dep.weight /= totalWeight;
+            }
+            aggregation = Aggregation::Sum;
+        }
+        return definitions;
+    }
+
+    void writeHeader(std::ostream &out, const std::string &name, const std::string &graphPath,
+                     const std::vector<size_t> &primaries, const size_t size) {
+        std::string guard = "LAB01_NONCOOPERATIVEMULTITHREADING_";
+        for (const auto character: name) {
+            guard += static_cast<char>(std::toupper(static_cast<unsigned char>(character)));
+        }
+        guard += "_HPP";
+        out << "// Generated by TopologyCompiler from " << graphPath << ", do not edit.\n\n"
+            << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+            << "#include <cstddef>\n\n#include \"VariableLock.hpp\"\n\n"
+            << "/// Straight-line updates and checks for one fixed topology of " << size << " variables\n"
+            << "class " << name << " {\npublic:\n"
+            << "    static constexpr size_t VARIABLE_COUNT = " << size << ";\n"
+            << "    static constexpr size_t PRIMARY_COUNT = " << primaries.size() << ";\n";
+        for (const auto primary: primaries) {
+            out << "\n    static void updateVariable" << primary
+                << "(double *variables, VariableLock *locks, double delta);\n";
+        }
+        out << "\n    /// Dispatches to the update of a primary\n"
+            << "    static void updateVariable(size_t primaryID, double *variables, VariableLock *locks, double delta);\n"
+            << "\n    /// Whether every secondary equals the weighted sum of its inputs; the caller holds every lock or\n"
+            << "    /// passes a snapshot\n"
+            << "    [[nodiscard]] static auto checkConsistency(const double *variables) -> bool;\n"
+            << "};\n\n#endif //" << guard << '\n';
+    }
+
+    void writeSource(std::ostream &out, const std::string &name, const std::string &graphPath,
+                     const std::vector<Definition> &definitions, const std::vector<size_t> &primaries,
+                     const std::vector<std::vector<std::pair<size_t, double>>> &closures) {
+        const auto size = definitions.size();
+        out << "// Generated by TopologyCompiler from " << graphPath << ", do not edit.\n\n"
+            << "#include \"" << name << ".hpp\"\n\n"
+            << "#include <algorithm>\n#include <array>\n#include <cassert>\n#include <cmath>\n\n";
+        for (size_t index = 0; index < primaries.size(); ++index) {
+            out << "void " << name << "::updateVariable" << primaries[index]
+                << "(double *variables, VariableLock *locks, const double delta) {\n";
+            for (const auto &[id, _]: closures[index]) {
+                out << "    locks[" << id << "].lock();\n";
+            }
+            for (const auto &[id, weight]: closures[index]) {
+                out << "    " << variable(id) << " += " << weighted(weight, "delta") << ";\n";
+            }
+            for (auto it = closures[index].crbegin(); it != closures[index].crend(); ++it) {
+                out << "    locks[" << it->first << "].unlock();\n";
+            }
+            out << "}\n\n";
+        }
+
+        out << "void " << name
+            << "::updateVariable(const size_t primaryID, double *variables, VariableLock *locks, const double delta) {\n"
+            << "    static constexpr std::array<void (*)(double *, VariableLock *, double), VARIABLE_COUNT> UPDATES{\n";
+        std::vector<std::string> updates(size, "nullptr");
+        for (const auto primary: primaries) {
+            updates[primary] = "&updateVariable" + std::to_string(primary);
+        }
+        for (const auto &update: updates) {
+            out << "            " << update << ",\n";
+        }
+        out << "    };\n"
+            << "    assert(primaryID < VARIABLE_COUNT && UPDATES[primaryID] && \"Only primaries can be updated\");\n"
+            << "    UPDATES[primaryID](variables, locks, delta);\n}\n\n";
+
+        // the sums fill two fixed-size arrays, so the comparison is one branch-free loop the compiler vectorises
+        std::vector<size_t> secondaries;
+        for (size_t id = 0; id < size; ++id) {
+            if (!definitions[id].dependencies.empty()) {
+                secondaries.push_back(id);
+            }
+        }
+        out << "auto " << name << "::checkConsistency(const double *variables) -> bool {\n"
+            << "    static constexpr size_t SECONDARY_COUNT = " << secondaries.size() << ";\n"
+            << "    static constexpr double RELATIVE_TOLERANCE = 1e-9;\n"
+            << "    const std::array<double, SECONDARY_COUNT> actual{\n";
+        for (const auto id: secondaries) {
+            out << "            " << variable(id) << ",\n";
+        }
+        out << "    };\n    const std::array<double, SECONDARY_COUNT> expected{\n";
+        for (const auto id: secondaries) {
+            std::string sum;
+            for (const auto &[dep, weight]: definitions[id].dependencies) {
+                sum += (sum.empty() ? "" : " + ") + weighted(weight, variable(dep));
+            }
+            out << "            " << sum << ",\n";
+        }
+        out << "    };\n"
+            << "    auto consistent = true;\n"
+            << "    for (size_t index = 0; index < SECONDARY_COUNT; ++index) {\n"
+            << "        consistent &= std::abs(actual[index] - expected[index]) <=\n"
+            << "                      RELATIVE_TOLERANCE * std::max({1.0, std::abs(actual[index]), "
+               "std::abs(expected[index])});\n"
+            << "    }\n    return consistent;\n}\n";
+    }
+}
+
+auto main(int argc, char **argv) -> int {
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <graph file> <class name> <output directory>\n";
+        return 1;
+    }
+    const std::string graphPath = argv[1];
+    const std::string name = argv[2];
+    const std::filesystem::path outputDirectory = argv[3];
+    std::vector<Definition> definitions;
+    try {
+        definitions = GraphFile::load(graphPath);
+        for (const auto &[aggregation, _]: definitions) {
+            if (aggregation != Aggregation::Sum && aggregation != Aggregation::Average) {
+                throw std::runtime_error(GraphFile::aggregationName(aggregation) +
+                                         " is not linear, so its updates cannot be compiled to straight-line code");
+            }
+        }
+        definitions = normaliseAverages(std::move(definitions));
+    } catch (const std::runtime_error &error) {
+        std::cerr << graphPath << ": " << error.what() << '\n';
+        return 1;
+    }
+    const auto size = definitions.size();
+    std::vector<std::vector<Edge>> dependents(size);
+    std::vector<size_t> primaries;
+    for (size_t id = 0; id < size; ++id) {
+        for (const auto &[dep, weight]: definitions[id].dependencies) {
+            dependents[dep].push_back({static_cast<VariableId>(id), weight});
+        }
+        if (definitions[id].dependencies.empty()) {
+            primaries.push_back(id);
+        }
+    }
+
+    // VariableSystem's ranks, as long as it splits no fan-in: its hidden aggregation variables are ranked too
+    const auto order = TopologicalOrder::compute<std::vector<VariableId>>(
+            size, dependents, [&](const VariableId id) { return definitions[id].dependencies.empty(); });
+    if (order.size() != size) {
+        std::cerr << graphPath << ": the dependencies form a cycle\n";
+        return 1;
+    }
+    std::vector<size_t> ranks(size);
+    for (size_t rank = 0; rank < size; ++rank) {
+        ranks[order[rank]] = rank;
+    }
+
+    // path-summed weights: pushing along the edges in rank order visits every path once
+    std::vector<std::vector<std::pair<size_t, double>>> closures;
+    closures.reserve(primaries.size());
+    for (const auto primary: primaries) {
+        std::map<size_t, double> weightsByRank{{ranks[primary], 1.0}};
+        for (auto it = weightsByRank.begin(); it != weightsByRank.end(); ++it) {
+            for (const auto &[dependent, weight]: dependents[order[it->first]]) {
+                weightsByRank[ranks[dependent]] += it->second * weight;
+            }
+        }
+        auto &closure = closures.emplace_back();
+        for (const auto &[rank, weight]: weightsByRank) {
+            closure.emplace_back(order[rank], weight);
+        }
+    }
+
+    std::ofstream header(outputDirectory / (name + ".hpp"));
+    std::ofstream source(outputDirectory / (name + ".cpp"));
+    if (!header || !source) {
+        std::cerr << "Cannot write " << name << ".hpp / .cpp to " << outputDirectory << '\n';
+        return 1;
+    }
+    writeHeader(header, name, graphPath, primaries, size);
+    writeSource(source, name, graphPath, definitions, primaries, closures);
+    std::cout << name << ": " << primaries.size() << " primaries, "
+              << std::accumulate(closures.cbegin(), closures.cend(), size_t{0},
+                                 [](size_t total, const auto &closure) { return total + closure.size(); })
+              << " closure entries\n";
+    return 0;
+}
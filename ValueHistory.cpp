@@ -0,0 +1,108 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "ValueHistory.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+ValueHistory::ValueHistory(const size_t retainedCheckpoints) : retainedCheckpoints(retainedCheckpoints) {}
+
+void ValueHistory::appendVarint(uint64_t value) {
+    while (value >= 0x80) {
+        entries.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    entries.push_back(static_cast<uint8_t>(value));
+}
+
+/* static */ auto ValueHistory::readVarint(const uint8_t *&cursor) -> uint64_t {
+    uint64_t value = 0;
+    for (auto shift = 0; ; shift += 7) {
+        value |= static_cast<uint64_t>(*cursor & 0x7F) << shift;
+        if (!(*cursor++ & 0x80)) {
+            return value;
+        }
+    }
+}
+
+void ValueHistory::append(const TimePoint time, const double value) {
+    assert((checkpoints.empty() || time >= lastTime) && "History entries must be appended in time order");
+    ++count;
+    if (checkpoints.empty() || entriesSinceCheckpoint == CHECKPOINT_INTERVAL - 1) {
+        checkpoints.push_back({time, value, entries.size()});
+        entriesSinceCheckpoint = 0;
+        // dropping half of the segments at a time keeps the cost of moving the rest constant per value
+        if (retainedCheckpoints && checkpoints.size() > 2 * retainedCheckpoints + 1) {
+            dropOldestSegments(checkpoints.size() - retainedCheckpoints - 1);
+        }
+    } else {
+        appendVarint(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time - lastTime).count()));
+        const auto change = value - lastValue;
+        if (std::abs(change) < MAX_INTEGRAL_CHANGE && std::trunc(change) == change && lastValue + change == value) {
+            const auto integral = static_cast<int64_t>(change);
+            const auto zigzag = (static_cast<uint64_t>(integral) << 1) ^ static_cast<uint64_t>(integral >> 63);
+            appendVarint(zigzag << 1);
+        } else {
+            appendVarint(RAW_VALUE);
+            uint8_t raw[sizeof(double)];
+            std::memcpy(raw, &value, sizeof(double));
+            entries.insert(entries.end(), raw, raw + sizeof(double));
+        }
+        ++entriesSinceCheckpoint;
+    }
+    lastTime = time;
+    lastValue = value;
+}
+
+void ValueHistory::dropOldestSegments(const size_t segmentCount) {
+    // only full segments are dropped, and each holds its checkpoint and CHECKPOINT_INTERVAL - 1 entries
+    assert(segmentCount < checkpoints.size() && "The newest segment is always retained");
+    const auto cut = checkpoints[segmentCount].offset;
+    entries.erase(entries.begin(), entries.begin() + static_cast<std::ptrdiff_t>(cut));
+    checkpoints.erase(checkpoints.begin(), checkpoints.begin() + static_cast<std::ptrdiff_t>(segmentCount));
+    for (auto &checkpoint: checkpoints) {
+        checkpoint.offset -= cut;
+    }
+    count -= segmentCount * CHECKPOINT_INTERVAL;
+}
+
+auto ValueHistory::valueAt(const TimePoint time) const -> double {
+    if (checkpoints.empty()) {
+        return 0;
+    }
+    // the last checkpoint at or before time; the entries up to the next one are replayed from it
+    auto checkpoint = std::upper_bound(checkpoints.cbegin(), checkpoints.cend(), time,
+                                       [](TimePoint lhs, const Checkpoint &rhs) { return lhs < rhs.time; });
+    if (checkpoint == checkpoints.cbegin()) {
+        return checkpoints.front().value;
+    }
+    --checkpoint;
+    auto value = checkpoint->value;
+    auto current = checkpoint->time;
+    const auto *cursor = entries.data() + checkpoint->offset;
+    const auto *const end = entries.data() + (checkpoint + 1 == checkpoints.cend() ? entries.size()
+                                                                                   : (checkpoint + 1)->offset);
+    while (cursor != end) {
+        current += std::chrono::nanoseconds(readVarint(cursor));
+        if (current > time) {
+            break;
+        }
+        const auto header = readVarint(cursor);
+        if (header == RAW_VALUE) {
+            std::memcpy(&value, cursor, sizeof(double));
+            cursor += sizeof(double);
+        } else {
+            const auto zigzag = header >> 1;
+            value += static_cast<double>(static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1));
+        }
+    }
+    return value;
+}
+
+auto ValueHistory::memoryUsage() const -> size_t {
+    return entries.capacity() + checkpoints.capacity() * sizeof(Checkpoint);
+}
@@ -0,0 +1,69 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_VALUEHISTORY_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_VALUEHISTORY_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Append-only log of the values one variable took over time. Every CHECKPOINT_INTERVAL-th value is stored in
+/// full as a checkpoint; the others are a LEB128 varint of the time since the previous value followed by either a
+/// zigzag varint of an integral change or an escape and the raw value, so typical entries take 2-4 bytes.
+/// With a retention limit, whole segments (a checkpoint and the entries after it) are dropped oldest first once
+/// twice as many as retained are complete, so between one and two times the limit stay besides the one filling.
+/// Not synchronised; appends must come in time order.
+class ValueHistory {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    static constexpr size_t CHECKPOINT_INTERVAL = 64;
+
+private:
+    struct Checkpoint {
+        TimePoint time;
+        double value;
+        /// where the entries following the checkpoint start
+        size_t offset;
+    };
+
+    /// the value header is even for a zigzag-encoded integral change, this for a raw value that follows
+    static constexpr uint64_t RAW_VALUE = 1;
+    /// integral changes up to this magnitude are exact in a double and fit the header
+    static constexpr double MAX_INTEGRAL_CHANGE = static_cast<double>(uint64_t{1} << 52);
+
+    /// complete segments kept at least, up to twice as many; 0 keeps every one
+    size_t retainedCheckpoints = 0;
+    std::vector<uint8_t> entries;
+    std::vector<Checkpoint> checkpoints;
+    TimePoint lastTime{};
+    double lastValue = 0;
+    size_t entriesSinceCheckpoint = 0;
+    size_t count = 0;
+
+    void appendVarint(uint64_t value);
+
+    [[nodiscard]] static auto readVarint(const uint8_t *&cursor) -> uint64_t;
+
+    void dropOldestSegments(size_t segmentCount);
+
+public:
+    ValueHistory() = default;
+
+    explicit ValueHistory(size_t retainedCheckpoints);
+
+    void append(TimePoint time, double value);
+
+    /// The last value appended at or before time; before the first value still retained, that value
+    [[nodiscard]] auto valueAt(TimePoint time) const -> double;
+
+    /// values retained
+    [[nodiscard]] auto size() const -> size_t { return count; }
+
+    [[nodiscard]] auto memoryUsage() const -> size_t;
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_VALUEHISTORY_HPP
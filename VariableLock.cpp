@@ -0,0 +1,223 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#include "VariableLock.hpp"
+
+#include <array>
+#include <chrono>
+#include <climits>
+#include <thread>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(sizeof(VariableLock) == 4, "A variable lock is a single futex word");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "A futex word must be a plain 32-bit integer");
+
+namespace {
+    /// 128 KB; a checker holding more biased locks than this at once falls back to counting for the rest
+    constexpr size_t VISIBLE_READER_SLOTS = size_t{1} << 14;
+    /// slots hold the lock address with the reader's thread tag in the (unused) top bits
+    constexpr unsigned THREAD_TAG_SHIFT = 48;
+    constexpr uintptr_t ADDRESS_MASK = (uintptr_t{1} << THREAD_TAG_SHIFT) - 1;
+
+    std::array<std::atomic<uintptr_t>, VISIBLE_READER_SLOTS> visibleReaders{};
+    std::atomic<uintptr_t> nextThreadTag{1};
+
+    /// per lock, by address hash, the steady clock time in nanoseconds before which it may not become reader-biased
+    /// again; locks sharing a slot only share their inhibition
+    constexpr size_t BIAS_INHIBITION_SLOTS = size_t{1} << 12;
+    /// the inhibition lasts this many times as long as the revocation took, bounding revocation to a tenth of the
+    /// time, as BRAVO does
+    constexpr int64_t BIAS_INHIBITION_FACTOR = 9;
+
+    std::array<std::atomic<int64_t>, BIAS_INHIBITION_SLOTS> biasInhibitedUntil{};
+
+    inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    auto futex(std::atomic<uint32_t> &word, const int operation, const uint32_t value) -> long {
+        return syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), operation, value, nullptr, nullptr, 0);
+    }
+
+    auto threadTag() -> uintptr_t {
+        thread_local const auto tag =
+                nextThreadTag.fetch_add(1, std::memory_order_relaxed) % ((uintptr_t{1} << (64 - THREAD_TAG_SHIFT)) - 1) + 1;
+        return tag;
+    }
+
+    auto visibleReaderSlot(const void *lock) -> std::atomic<uintptr_t> & {
+        const auto hash = (reinterpret_cast<uintptr_t>(lock) >> 2) ^ (threadTag() * 0x9E3779B97F4A7C15ULL);
+        return visibleReaders[(hash ^ (hash >> 29)) % VISIBLE_READER_SLOTS];
+    }
+
+    auto visibleReaderEntry(const void *lock) -> uintptr_t {
+        return reinterpret_cast<uintptr_t>(lock) | threadTag() << THREAD_TAG_SHIFT;
+    }
+
+    auto biasInhibition(const void *lock) -> std::atomic<int64_t> & {
+        const auto hash = (reinterpret_cast<uintptr_t>(lock) >> 2) * 0x9E3779B97F4A7C15ULL;
+        return biasInhibitedUntil[(hash >> 32) % BIAS_INHIBITION_SLOTS];
+    }
+
+    auto nanosecondsNow() -> int64_t {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+auto VariableLock::withReader(const uint32_t word) const -> uint32_t {
+    if ((word & STREAK_MASK) != STREAK_MASK) {
+        return word + READER + STREAK_UNIT;
+    }
+    // a complete streak only reads the clock once every few counted reads, while the bias is inhibited
+    if (nanosecondsNow() < biasInhibition(this).load(std::memory_order_relaxed)) {
+        return (word + READER) & ~STREAK_MASK;
+    }
+    return (word + READER) | BIAS;
+}
+
+auto VariableLock::tryVisibleRead() -> bool {
+    auto &slot = visibleReaderSlot(this);
+    uintptr_t expected = 0;
+    if (!slot.compare_exchange_strong(expected, visibleReaderEntry(this), std::memory_order_seq_cst)) {
+        return false;
+    }
+    // a writer clears the bias before scanning the slots, so either it sees this slot or this sees no bias
+    if (state.load(std::memory_order_seq_cst) & BIAS) {
+        return true;
+    }
+    slot.store(0, std::memory_order_relaxed);
+    return false;
+}
+
+auto VariableLock::releaseVisibleRead() -> bool {
+    auto &slot = visibleReaderSlot(this);
+    if (slot.load(std::memory_order_relaxed) != visibleReaderEntry(this)) {
+        return false;
+    }
+    slot.store(0, std::memory_order_release);
+    return true;
+}
+
+void VariableLock::revokeBias() const {
+    const auto start = nanosecondsNow();
+    const auto address = reinterpret_cast<uintptr_t>(this);
+    for (const auto &slot: visibleReaders) {
+        while ((slot.load(std::memory_order_seq_cst) & ADDRESS_MASK) == address) {
+            std::this_thread::yield();
+        }
+    }
+    const auto end = nanosecondsNow();
+    biasInhibition(this).store(end + (end - start) * BIAS_INHIBITION_FACTOR, std::memory_order_relaxed);
+}
+
+void VariableLock::queueWriter(uint32_t &word) {
+    if (!(word & WRITER_QUEUED)) {
+        word = state.fetch_or(WRITER_QUEUED, std::memory_order_relaxed) | WRITER_QUEUED;
+    }
+}
+
+void VariableLock::backOffOrPark(const uint32_t word, const uint32_t round) {
+    // the holder is most likely running and about to finish its closure, so waiting a little beats sleeping
+    if (round < SPIN_ROUNDS) {
+        for (uint32_t i = 0; i < 1U << round; ++i) {
+            cpuRelax();
+        }
+        return;
+    }
+    // the kernel only puts us to sleep if the word still has the waiters bit, so a wake-up cannot be missed
+    auto expected = word;
+    if (word & WAITERS ||
+        state.compare_exchange_strong(expected, word | WAITERS, std::memory_order_relaxed, std::memory_order_relaxed)) {
+        futex(state, FUTEX_WAIT_PRIVATE, word | WAITERS);
+    }
+}
+
+void VariableLock::wakeAll() {
+    futex(state, FUTEX_WAKE_PRIVATE, INT_MAX);
+}
+
+void VariableLock::lock() {
+    for (uint32_t round = 0;; ++round) {
+        auto word = state.load(std::memory_order_relaxed);
+        if (word & (WRITER | READER_MASK)) {
+            // from now on arriving readers wait; the queued bit is cleared by whichever writer gets the lock next, and
+            // writers still waiting then set it again
+            queueWriter(word);
+            backOffOrPark(word, round);
+            continue;
+        }
+        if (state.compare_exchange_weak(word, (word | WRITER) & ~(BIAS | STREAK_MASK | WRITER_QUEUED),
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+            if (word & BIAS) {
+                revokeBias();
+            }
+            return;
+        }
+    }
+}
+
+auto VariableLock::try_lock() -> bool {
+    auto word = state.load(std::memory_order_relaxed);
+    if (word & (WRITER | READER_MASK) ||
+        !state.compare_exchange_strong(word, (word | WRITER) & ~(BIAS | STREAK_MASK | WRITER_QUEUED),
+                                       std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return false;
+    }
+    if (word & BIAS) {
+        revokeBias();
+    }
+    return true;
+}
+
+void VariableLock::unlock() {
+    if (state.fetch_and(~(WRITER | WAITERS), std::memory_order_release) & WAITERS) {
+        wakeAll();
+    }
+}
+
+void VariableLock::lock_shared() {
+    if ((state.load(std::memory_order_relaxed) & (BIAS | WRITER_QUEUED)) == BIAS && tryVisibleRead()) {
+        return;
+    }
+    for (uint32_t round = 0;; ++round) {
+        auto word = state.load(std::memory_order_relaxed);
+        if (word & (WRITER | WRITER_QUEUED)) {
+            backOffOrPark(word, round);
+            continue;
+        }
+        if (state.compare_exchange_weak(word, withReader(word), std::memory_order_acquire, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+auto VariableLock::try_lock_shared() -> bool {
+    if ((state.load(std::memory_order_relaxed) & (BIAS | WRITER_QUEUED)) == BIAS && tryVisibleRead()) {
+        return true;
+    }
+    auto word = state.load(std::memory_order_relaxed);
+    return !(word & (WRITER | WRITER_QUEUED)) &&
+           state.compare_exchange_strong(word, withReader(word), std::memory_order_acquire, std::memory_order_relaxed);
+}
+
+void VariableLock::unlock_shared() {
+    if (releaseVisibleRead()) {
+        return;
+    }
+    // the last counted reader hands the lock to whoever parked, which can only be a writer or readers behind one
+    const auto word = state.fetch_sub(READER, std::memory_order_release);
+    if ((word & READER_MASK) == READER && word & WAITERS) {
+        state.fetch_and(~WAITERS, std::memory_order_relaxed);
+        wakeAll();
+    }
+}
@@ -0,0 +1,80 @@
+//
+// Created by victo on 17/10/2026.
+//
+
+#ifndef LAB01_NONCOOPERATIVEMULTITHREADING_VARIABLELOCK_HPP
+#define LAB01_NONCOOPERATIVEMULTITHREADING_VARIABLELOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/// A 4-byte reader / writer lock for one variable. Acquiring spins with exponential backoff for about as long as
+/// a closure update holds its locks, then parks the thread on a futex; releasing only enters the kernel if someone
+/// parked. Satisfies SharedLockable, so it works with std::unique_lock, std::lock_guard and std::shared_lock.
+///
+/// Shared acquisitions normally count themselves in the lock word. A lock that keeps being read without being
+/// written becomes reader-biased: readers then only publish themselves in a process-wide table of visible-reader
+/// slots, spread by thread and lock, so concurrent readers stop bouncing the lock word between cores. The next
+/// writer revokes the bias and waits for the published readers to leave; as in BRAVO, the bias then stays off for
+/// several times as long as the revocation took, so locks that are written now and then do not pay for a scan of
+/// the slots on every write.
+///
+/// A writer that has to wait announces itself, and readers arriving after that wait behind it, so a steady stream
+/// of overlapping readers cannot starve writers.
+class VariableLock {
+private:
+    /// Tests.cpp checks the bias and the writer-queued bit in the lock word
+    friend class VariableSystemTests;
+
+    static constexpr uint32_t WRITER = 1U << 0;
+    /// a thread may be parked waiting for the lock
+    static constexpr uint32_t WAITERS = 1U << 1;
+    /// readers may hold the lock through visible-reader slots instead of the count
+    static constexpr uint32_t BIAS = 1U << 2;
+    /// counted shared acquisitions since the last exclusive one; the bias is set when the streak is complete
+    static constexpr uint32_t STREAK_UNIT = 1U << 3;
+    static constexpr uint32_t STREAK_MASK = 0xFU * STREAK_UNIT;
+    /// a writer is waiting for the lock; new readers wait behind it
+    static constexpr uint32_t WRITER_QUEUED = 1U << 7;
+    static constexpr uint32_t READER = 1U << 8;
+    static constexpr uint32_t READER_MASK = ~(READER - 1);
+    /// backoff doubles from 1 pause per round to 64 before parking
+    static constexpr uint32_t SPIN_ROUNDS = 7;
+
+    std::atomic<uint32_t> state{0};
+
+    [[nodiscard]] auto withReader(uint32_t word) const -> uint32_t;
+
+    [[nodiscard]] auto tryVisibleRead() -> bool;
+
+    [[nodiscard]] auto releaseVisibleRead() -> bool;
+
+    void revokeBias() const;
+
+    void queueWriter(uint32_t &word);
+
+    void backOffOrPark(uint32_t word, uint32_t round);
+
+    void wakeAll();
+
+public:
+    VariableLock() = default;
+
+    VariableLock(const VariableLock &) = delete;
+
+    auto operator=(const VariableLock &) -> VariableLock & = delete;
+
+    void lock();
+
+    [[nodiscard]] auto try_lock() -> bool; // NOLINT(*-identifier-naming)
+
+    void unlock();
+
+    void lock_shared(); // NOLINT(*-identifier-naming)
+
+    [[nodiscard]] auto try_lock_shared() -> bool; // NOLINT(*-identifier-naming)
+
+    void unlock_shared(); // NOLINT(*-identifier-naming)
+};
+
+#endif //LAB01_NONCOOPERATIVEMULTITHREADING_VARIABLELOCK_HPP
@@ -5,41 +5,52 @@
 #include "VariableSystem.hpp"
 
 #include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cmath>
 #include <functional>
+#include <condition_variable>
 #include <iostream>
 #include <latch>
+#include <limits>
 #include <numeric>
 #include <random>
 #include <stack>
 #include <string>
 #include <syncstream>
 #include <thread>
+#include <tuple>
+#include <unordered_map>
+
+#include "TopologicalOrder.hpp"
 /*
     Paste into result to see where threads do *NOT* overlap
     .*Thread ([0-9])+.*(\n.*Thread \1.*)
  */
-/* static */ auto VariableSystem::random() -> int {
+/* static */ auto VariableSystem::randomGenerator() -> std::mt19937 & {
     static std::random_device device;
     static std::mt19937 generator(device());
+    return generator;
+}
+
+/* static */ auto VariableSystem::random() -> int {
     static std::uniform_int_distribution<int> distribution(0, INT_MAX);
-    return distribution(generator);
+    return distribution(randomGenerator());
 }
 
-/* static */ auto
-VariableSystem::search(const size_t startID,
-                       const std::vector<std::vector<size_t>> &searchSpace) -> std::vector<size_t> {
-    std::set<size_t> visited{startID};
-    std::vector<size_t> result{startID};
-    std::stack<size_t> stack;
+template<typename Adjacency>
+/* static */ auto VariableSystem::search(const VariableId startID, const Adjacency &searchSpace) -> std::vector<VariableId> {
+    std::set<VariableId> visited{startID};
+    std::vector<VariableId> result{startID};
+    std::stack<VariableId> stack;
     stack.emplace(startID);
     while (!stack.empty()) {
         const auto current = stack.top();
         stack.pop();
-        for (const auto dep: searchSpace[current]) {
-            result.emplace_back(dep);
+        for (const auto &[dep, _]: searchSpace[current]) {
             if (visited.find(dep) == visited.end()) {
                 visited.insert(dep);
+                result.emplace_back(dep);
                 stack.emplace(dep);
             }
         }
@@ -48,17 +59,209 @@ VariableSystem::search(const size_t startID,
     return result;
 }
 
-VariableSystem::VariableSystem(const std::vector<std::vector<size_t>> &&deps)
-        : dependencies(deps),
+/* static */ auto
+VariableSystem::foldDuplicates(const std::vector<std::vector<size_t>> &deps) -> std::vector<std::vector<Dependency>> {
+    std::vector<std::vector<Dependency>> weighted;
+    weighted.reserve(deps.size());
+    for (const auto &ids: deps) {
+        auto &folded = weighted.emplace_back();
+        for (const auto id: ids) {
+            const auto existing = std::find_if(folded.begin(), folded.end(),
+                                               [id](const Dependency &dep) { return dep.id == id; });
+            if (existing == folded.end()) {
+                folded.push_back({id, 1});
+            } else {
+                existing->weight += 1;
+            }
+        }
+    }
+    return weighted;
+}
+
+/* static */ auto VariableSystem::asSums(const std::vector<std::vector<Dependency>> &deps) -> std::vector<Definition> {
+    std::vector<Definition> definitions;
+    definitions.reserve(deps.size());
+    for (const auto &dependencyVector: deps) {
+        definitions.push_back({Aggregation::Sum, dependencyVector});
+    }
+    return definitions;
+}
+
+/* static */ auto
+VariableSystem::extractAggregations(const std::vector<Definition> &definitions) -> std::vector<Aggregation> {
+    std::vector<Aggregation> aggregationVector;
+    aggregationVector.reserve(definitions.size());
+    for (const auto &definition: definitions) {
+        aggregationVector.push_back(definition.aggregation);
+    }
+    return aggregationVector;
+}
+
+/* static */ auto
+VariableSystem::extractDependencies(const std::vector<Definition> &definitions)
+-> std::vector<std::vector<Edge>> {
+    assert(definitions.size() <= std::numeric_limits<VariableId>::max() && "Too many variables for 32-bit ids");
+    std::vector<std::vector<Edge>> dependencyVector;
+    dependencyVector.reserve(definitions.size());
+    for (const auto &definition: definitions) {
+        auto &edges = dependencyVector.emplace_back();
+        edges.reserve(definition.dependencies.size());
+        for (const auto &[id, weight]: definition.dependencies) {
+            edges.push_back({static_cast<VariableId>(id), weight});
+        }
+    }
+    return dependencyVector;
+}
+
+/* static */ auto
+VariableSystem::restructure(const std::vector<Definition> &definitions, const size_t maxFanIn) -> std::vector<Definition> {
+    std::vector<Definition> restructured(definitions.cbegin(), definitions.cend());
+    for (auto index = 0; index < definitions.size(); ++index) {
+        if (restructured[index].aggregation == Aggregation::Average) {
+            // an average is the sum of its inputs with the weights normalised to 1
+            auto &deps = restructured[index].dependencies;
+            const auto totalWeight = std::accumulate(deps.cbegin(), deps.cend(), Weight{0},
+                                                     [](Weight partialSum, const Dependency &dep) {
+                                                         return partialSum + dep.weight;
+                                                     });
+            assert(totalWeight != 0 && "Average over inputs whose weights sum to zero");
+            for (auto &dep: deps) {
+                dep.weight /= totalWeight;
+            }
+        }
+        if (maxFanIn < 2 || restructured[index].dependencies.size() <= maxFanIn) { continue; }
+        // hidden variables aggregate balanced chunks of the inputs, their parents combine the partial results
+        const auto partialAggregation = restructured[index].aggregation == Aggregation::Average
+                                        ? Aggregation::Sum : restructured[index].aggregation;
+        const auto combiningAggregation = partialAggregation == Aggregation::CountNonZero
+                                          ? Aggregation::Sum : partialAggregation;
+        auto aggregation = partialAggregation;
+        auto level = std::move(restructured[index].dependencies);
+        while (level.size() > maxFanIn) {
+            const auto chunkCount = (level.size() + maxFanIn - 1) / maxFanIn;
+            std::vector<Dependency> parents;
+            parents.reserve(chunkCount);
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+                const auto begin = level.cbegin() + static_cast<std::ptrdiff_t>(chunk * level.size() / chunkCount);
+                const auto end = level.cbegin() + static_cast<std::ptrdiff_t>((chunk + 1) * level.size() / chunkCount);
+                parents.push_back({restructured.size(), 1});
+                restructured.push_back({aggregation, {begin, end}});
+            }
+            level = std::move(parents);
+            aggregation = combiningAggregation;
+        }
+        restructured[index] = {aggregation, std::move(level)};
+    }
+    return restructured;
+}
+
+/* static */ auto VariableSystem::isLinear(const Aggregation aggregation) -> bool {
+    return aggregation == Aggregation::Sum || aggregation == Aggregation::Average;
+}
+
+/* static */ auto VariableSystem::approximatelyEqual(const Value expected, const Value actual) -> bool {
+    // exact for integer weights; fractional weights accumulate rounding error over many deltas
+    return std::abs(expected - actual) <=
+           CONSISTENCY_RELATIVE_TOLERANCE * std::max({Value{1}, std::abs(expected), std::abs(actual)});
+}
+
+VariableSystem::VariableSystem(const std::vector<std::vector<size_t>> &&deps, const Options &options)
+        : VariableSystem(foldDuplicates(deps), options) {}
+
+VariableSystem::VariableSystem(const std::vector<std::vector<Dependency>> &&deps, const Options &options)
+        : VariableSystem(asSums(deps), options) {}
+
+VariableSystem::VariableSystem(const std::vector<Definition> &&definitions, const Options &options)
+        : VariableSystem(restructure(definitions, options.maxFanIn), definitions.size(), options) {}
+
+VariableSystem::VariableSystem(const std::vector<Definition> &&definitions,
+                               const size_t visibleSize,
+                               const Options &options)
+        : size(definitions.size()),
+          visibleSize(visibleSize),
+          options(options),
+          clock(createClock()),
+          aggregations(extractAggregations(definitions)),
+          variables(createVariables()),
+          dependencies(extractDependencies(definitions)),
+          planCache(openPlanCache()),
           dependents(computeDependents()),
+          topologicalOrder(computeTopologicalOrder()),
+          ranks(computeRanks()),
+          closures(computeClosures()),
+          linearClosures(computeLinearClosures()),
+          plans(compilePlans()),
+          closureCache(createClosureCache()),
+          orderedInputs(createOrderedInputs()),
+          lazy(createLazyFlags()),
+          stale(size),
+          accessStatistics(size),
           locks(createLocks()),
-          variables(createVariables()),
-          size(deps.size()) {
+          primaryStatistics(size),
+          primaries(collectPrimaries()),
+          secondaries(collectSecondaries()),
+          checksumCoefficients(computeChecksumCoefficients()),
+          primaryChecksumWeights(computePrimaryChecksumWeights()),
+          checkSampleSize(computeCheckSampleSize()),
+          sampledSinceFullCheck(size),
+          mailboxes(size),
+          notificationSequences(size),
+          histories(createHistories()),
+          historyLocks(histories.size()),
+          assignment(createAssignment()),
+          workerCpus(createWorkerCpus()) {
     assert(size == variables.size() && "Mismatch between variable vector size and system size");
     assert(size == dependencies.size() && "Mismatch between dependencies vector size and system size");
     assert(size == dependents.size() && "Mismatch between dependents vector size and system size");
+    assert(size == topologicalOrder.size() && "Dependencies between variables form a cycle");
+    assert((closureCache || size == closures.size()) && "Mismatch between closures vector size and system size");
     assert(size == locks.size() && "Mismatch between locks vector size and system size");
+    const auto planCacheHit = planCache.has_value();
+    planCache.reset();
+    // main rejects the combination; this only catches other callers
+    assert(!(options.service && options.clock) && "Service mode runs until a signal, in real time");
     std::cout << "THREAD COUNT = " << THREAD_COUNT << '\n';
+    std::cout << "HIDDEN AGGREGATION VARIABLES = " << size - visibleSize << '\n';
+    std::cout << "GRAPH MEMORY BYTES = "
+              << dependencies.memoryUsage() + dependents.memoryUsage() + closures.memoryUsage() << '\n';
+    std::cout << "CLOSURE RUNS = " << closures.runCount() << '\n';
+    std::cout << "PROPAGATION PLAN BYTES = " << plans.memoryUsage() << '\n';
+    std::cout << "CLOSURE CACHE = ";
+    if (closureCache) {
+        std::cout << options.closureCacheBytes << " BYTES\n";
+    } else {
+        std::cout << "OFF\n";
+    }
+    std::cout << "PLAN CACHE = " << (options.planCachePath.empty() ? "OFF" :
+                                     planCacheHit ? "HIT" :
+                                     savePlanCache() ? "MISS, SAVED" : "MISS, NOT SAVED") << '\n';
+    const auto hugePageStatistics = HugePages::statistics();
+    std::cout << "HUGE PAGE BYTES = " << hugePageStatistics.explicitBytes << " explicit, "
+              << hugePageStatistics.transparentBytes << " transparent\n";
+    std::cout << "PROPAGATION = " << (options.propagation == PropagationMode::Eager ? "EAGER" :
+                                      options.propagation == PropagationMode::Lazy ? "LAZY" : "ADAPTIVE") << '\n';
+    std::cout << "CHECKER THREADS = " << std::max<size_t>(options.checkerThreads, 1) << '\n';
+    if (checkSampleSize) {
+        std::cout << "CHECK SAMPLE SIZE = " << checkSampleSize << " of " << secondaries.size()
+                  << " secondaries, FULL CHECK INTERVAL = " << options.fullCheckInterval << '\n';
+    }
+    std::cout << "CHECKSUM = " << (checksumCoefficients.empty() ? "OFF" : "ON") << '\n';
+    std::cout << "AFFINITY = " << (options.affinity ? "ON" : "OFF") << '\n';
+    std::cout << "PINNED WORKER CPUS =";
+    for (const auto &[cpu, node]: workerCpus) {
+        std::cout << ' ' << cpu << " (node " << node << ')';
+    }
+    std::cout << (workerCpus.empty() ? " OFF\n" : "\n");
+    const auto placedBytes = placeMemory();
+    std::cout << "MEMORY PLACEMENT = " << (options.placement == MemoryPlacement::Default ? "DEFAULT" :
+                                           options.placement == MemoryPlacement::Local ? "LOCAL" : "INTERLEAVED")
+              << ", " << placedBytes << " bytes placed\n";
+    std::cout << "CLOCK = " << (options.clock ? "INJECTED" : "STEADY");
+    if (options.seed) {
+        std::cout << ", SEED = " << *options.seed;
+    }
+    std::cout << '\n';
+    std::cout << "SERVICE MODE = " << (options.service ? "ON" : "OFF") << '\n';
     std::cout << "WORKER MAX SLEEP TIME MS = " << WORKER_MAX_SLEEP_TIME_MS << '\n';
     std::cout << "CC MAX SLEEP TIME MS = " << CC_MAX_SLEEP_TIME_MS << '\n';
     std::cout.flush();
@@ -70,9 +273,9 @@ VariableSystem::VariableSystem(const std::vector<std::vector<size_t>> &&deps)
 auto VariableSystem::variablesAsString() const -> std::string {
     std::ostringstream oss;
     oss << "[";
-    for (auto i = 0; i < variables.size(); ++i) {
+    for (auto i = 0; i < visibleSize; ++i) {
         oss << "{" << i << " : " << variables[i] << "}";
-        if (i < variables.size() - 1) {
+        if (i < visibleSize - 1) {
             oss << ", ";
         }
     }
@@ -80,131 +283,1248 @@ auto VariableSystem::variablesAsString() const -> std::string {
     return oss.str();
 }
 
-auto VariableSystem::computeDependents() const -> std::vector<std::vector<size_t>> {
-    std::vector<std::vector<size_t>> inverseDependencies{};
-    inverseDependencies.reserve(size);
+auto VariableSystem::computeGraphKey() const -> uint64_t {
+    PlanCache::Hasher hasher(CACHED_STRUCTURES_VERSION);
+    hasher.add(size);
+    hasher.add(visibleSize);
+    // runs with a closure cache save no closures or plans
+    hasher.add(options.closureCacheBytes != 0);
+    for (auto id = 0; id < size; ++id) {
+        hasher.add(static_cast<uint64_t>(aggregations[id]) << 32 | dependencies[id].size());
+        for (const auto &[dependency, weight]: dependencies[id]) {
+            hasher.add(dependency);
+            hasher.add(std::bit_cast<uint64_t>(weight));
+        }
+    }
+    return hasher.value();
+}
+
+auto VariableSystem::openPlanCache() const -> std::optional<PlanCache> {
+    if (options.planCachePath.empty()) {
+        return std::nullopt;
+    }
+    auto cache = PlanCache::open(options.planCachePath, computeGraphKey());
+    if (cache && cache->sectionCount() != static_cast<size_t>(CachedStructure::Count)) {
+        return std::nullopt;
+    }
+    return cache;
+}
+
+auto VariableSystem::savePlanCache() const -> bool {
+    std::vector<PlanCache::Writer> sections(static_cast<size_t>(CachedStructure::Count));
+    dependents.save(sections[static_cast<size_t>(CachedStructure::Dependents)]);
+    sections[static_cast<size_t>(CachedStructure::TopologicalOrder)].write(topologicalOrder);
+    sections[static_cast<size_t>(CachedStructure::Ranks)].write(ranks);
+    closures.save(sections[static_cast<size_t>(CachedStructure::Closures)]);
+    plans.save(sections[static_cast<size_t>(CachedStructure::Plans)]);
+    return PlanCache::save(options.planCachePath, computeGraphKey(), sections);
+}
+
+auto VariableSystem::computeDependents() const -> CompactAdjacency {
+    if (planCache) {
+        return CompactAdjacency(planCache->section(static_cast<size_t>(CachedStructure::Dependents)));
+    }
+    std::vector<std::vector<Edge>> inverseDependencies(size);
     for (auto dependentIndex = 0; dependentIndex < size; ++dependentIndex) {
-        inverseDependencies.emplace_back();
-        for (auto dependencyIndex = 0; dependencyIndex < size; ++dependencyIndex) {
-            const auto count = std::count(dependencies[dependencyIndex].cbegin(),
-                                          dependencies[dependencyIndex].cend(),
-                                          dependentIndex);
-            for (int i = 0; i < count; ++i) {
-                inverseDependencies[dependentIndex].emplace_back(dependencyIndex);
-            }
+        for (const auto &[dependencyIndex, weight]: dependencies[dependentIndex]) {
+            assert(dependencyIndex < size && "Dependency on a variable that is not part of the system");
+            inverseDependencies[dependencyIndex].push_back({static_cast<VariableId>(dependentIndex), weight});
+        }
+    }
+    return CompactAdjacency(inverseDependencies);
+}
+
+auto VariableSystem::computeTopologicalOrder() const -> HugePageVector<VariableId> {
+    if (planCache) {
+        HugePageVector<VariableId> order;
+        planCache->section(static_cast<size_t>(CachedStructure::TopologicalOrder)).read(order);
+        return order;
+    }
+    // a cycle leaves the order empty, which fails the size check in the constructor
+    return TopologicalOrder::compute<HugePageVector<VariableId>>(
+            size, dependents, [this](const VariableId id) { return dependencies[id].empty(); });
+}
+
+auto VariableSystem::computeRanks() const -> HugePageVector<VariableId> {
+    HugePageVector<VariableId> rankVector;
+    if (planCache) {
+        planCache->section(static_cast<size_t>(CachedStructure::Ranks)).read(rankVector);
+        return rankVector;
+    }
+    rankVector.resize(size);
+    for (auto position = 0; position < size; ++position) {
+        rankVector[topologicalOrder[position]] = position;
+    }
+    return rankVector;
+}
+
+auto VariableSystem::computeClosure(const VariableId primaryID) const -> std::vector<Edge> {
+    // reverse post-order of the reachable sub-DAG is a topological order for it
+    std::vector<VariableId> postOrder;
+    std::set<VariableId> visited{primaryID};
+    std::stack<std::pair<VariableId, size_t>> stack;
+    stack.emplace(primaryID, 0);
+    while (!stack.empty()) {
+        auto &[current, nextEdge] = stack.top();
+        if (nextEdge == dependents[current].size()) {
+            postOrder.push_back(current);
+            stack.pop();
+            continue;
+        }
+        const auto next = dependents[current][nextEdge++].id;
+        if (visited.insert(next).second) {
+            stack.emplace(next, 0);
+        }
+    }
+    // a variable's effective weight is the sum, over all paths from the primary, of the edge weight products
+    std::unordered_map<VariableId, Weight> effectiveWeights{{primaryID, 1}};
+    for (auto it = postOrder.crbegin(); it != postOrder.crend(); ++it) {
+        const auto weight = effectiveWeights[*it];
+        for (const auto &[dependent, edgeWeight]: dependents[*it]) {
+            effectiveWeights[dependent] += weight * edgeWeight;
+        }
+    }
+    std::vector<Edge> closure;
+    closure.reserve(effectiveWeights.size());
+    for (const auto &[id, weight]: effectiveWeights) {
+        closure.push_back({id, weight});
+    }
+    return closure;
+}
+
+auto VariableSystem::computeClosures() const -> SharedRunAdjacency {
+    if (options.closureCacheBytes) {
+        return {};
+    }
+    if (planCache) {
+        return {planCache->section(static_cast<size_t>(CachedStructure::Closures)), topologicalOrder};
+    }
+    // locks are always taken in topological rank order, so closures are kept sorted by it
+    std::vector<std::vector<Edge>> closureVector(size);
+    for (auto i = 0; i < size; ++i) {
+        if (dependencies[i].empty()) {
+            closureVector[i] = computeClosure(i);
+            std::sort(closureVector[i].begin(), closureVector[i].end(),
+                      [this](const Edge &lhs, const Edge &rhs) { return ranks[lhs.id] < ranks[rhs.id]; });
+        }
+    }
+    return {closureVector, ranks, topologicalOrder};
+}
+
+auto VariableSystem::computeLinearClosures() const -> std::vector<bool> {
+    // a closure is linear when the closures of everything the variable feeds are, so walking the topological
+    // order backwards decides it for every variable without expanding a single closure
+    std::vector<bool> linearVector(size, true);
+    for (auto rank = size; rank-- > 0;) {
+        const auto id = topologicalOrder[rank];
+        linearVector[id] = isLinear(aggregations[id]) &&
+                           std::all_of(dependents[id].cbegin(), dependents[id].cend(),
+                                       [&linearVector](const Edge &dependent) { return linearVector[dependent.id]; });
+    }
+    return linearVector;
+}
+
+auto VariableSystem::compilePlans() const -> PropagationPlans {
+    if (options.closureCacheBytes) {
+        return {};
+    }
+    if (planCache) {
+        return PropagationPlans(planCache->section(static_cast<size_t>(CachedStructure::Plans)));
+    }
+    return {closures, linearClosures};
+}
+
+auto VariableSystem::createClosureCache() const -> std::unique_ptr<BoundedCache<VariableId, CompiledClosure>> {
+    if (!options.closureCacheBytes) {
+        return nullptr;
+    }
+    return std::make_unique<BoundedCache<VariableId, CompiledClosure>>(options.closureCacheBytes);
+}
+
+auto VariableSystem::compileClosure(const VariableId primaryID) const -> std::shared_ptr<const CompiledClosure> {
+    // what the primary reaches, in rank order; pushing its weight along the edges in that order visits every path
+    // once, so each variable's path-summed weight is complete by the time it is reached
+    auto reached = search(primaryID, dependents);
+    std::sort(reached.begin(), reached.end(),
+              [this](const VariableId lhs, const VariableId rhs) { return ranks[lhs] < ranks[rhs]; });
+    std::unordered_map<VariableId, Weight> effectiveWeights{{primaryID, 1}};
+    std::vector<std::vector<Edge>> rows(1);
+    rows[0].reserve(reached.size());
+    for (const auto id: reached) {
+        const auto weight = effectiveWeights[id];
+        rows[0].push_back({id, weight});
+        for (const auto &[dependent, edgeWeight]: dependents[id]) {
+            effectiveWeights[dependent] += weight * edgeWeight;
         }
     }
-    return inverseDependencies;
+    SharedRunAdjacency closure(rows, ranks, topologicalOrder);
+    PropagationPlans plans(closure, {linearClosures[primaryID]});
+    return std::make_shared<const CompiledClosure>(std::move(closure), std::move(plans));
 }
 
-auto VariableSystem::createLocks() const -> std::vector<std::unique_ptr<std::mutex>> {
-    std::vector<std::unique_ptr<std::mutex>> mutexVector;
-    mutexVector.reserve(size);
+auto VariableSystem::closureOf(const size_t primaryID, const ClosureUse use) const -> ClosureHandle {
+    if (!closureCache) {
+        return {nullptr, closures[primaryID], plans[primaryID], &plans};
+    }
+    auto compiled = closureCache->find(static_cast<VariableId>(primaryID));
+    if (use == ClosureUse::Update) {
+        metrics.add(compiled ? Metrics::Counter::ClosureCacheHits : Metrics::Counter::ClosureCacheMisses);
+    }
+    if (!compiled) {
+        compiled = compileClosure(static_cast<VariableId>(primaryID));
+        if (use == ClosureUse::Update) {
+            const auto bytes =
+                    sizeof(CompiledClosure) + compiled->closure.memoryUsage() + compiled->plans.memoryUsage();
+            auto [cached, evictions] = closureCache->insert(static_cast<VariableId>(primaryID), compiled, bytes);
+            metrics.add(Metrics::Counter::ClosureCacheEvictions, evictions);
+            compiled = std::move(cached);
+        }
+    }
+    return {compiled, compiled->closure[0], compiled->plans[0], &compiled->plans};
+}
+
+void VariableSystem::reportClosureCache() const {
+    if (!closureCache) {
+        return;
+    }
+    const auto hits = metrics.total(Metrics::Counter::ClosureCacheHits);
+    const auto misses = metrics.total(Metrics::Counter::ClosureCacheMisses);
+    std::osyncstream(std::cout)
+            << "[Closure cache] " << hits << " hits, " << misses << " misses, "
+            << (hits + misses ? 100.0 * static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0)
+            << "% hit rate, " << metrics.total(Metrics::Counter::ClosureCacheEvictions) << " evictions, "
+            << closureCache->entryCount() << " closures in " << closureCache->memoryUsage() << " bytes\n";
+}
+
+auto VariableSystem::createOrderedInputs() const -> std::vector<std::map<Value, size_t>> {
+    std::vector<std::map<Value, size_t>> orderedVector(size);
     for (auto i = 0; i < size; ++i) {
-        mutexVector.emplace_back(std::make_unique<std::mutex>());
+        if (aggregations[i] == Aggregation::Min || aggregations[i] == Aggregation::Max) {
+            // every variable starts at 0, so every input term does too
+            orderedVector[i].emplace(Value{0}, dependencies[i].size());
+        }
+    }
+    return orderedVector;
+}
+
+auto VariableSystem::createLazyFlags() const -> std::vector<std::atomic<bool>> {
+    std::vector<std::atomic<bool>> lazyVector(size);
+    if (options.propagation == PropagationMode::Lazy) {
+        for (auto i = 0; i < size; ++i) {
+            lazyVector[i].store(!dependencies[i].empty(), std::memory_order_relaxed);
+        }
+    }
+    return lazyVector;
+}
+
+void VariableSystem::rebuildOrderedInputs(const size_t variableID) {
+    if (aggregations[variableID] != Aggregation::Min && aggregations[variableID] != Aggregation::Max) { return; }
+    auto &terms = orderedInputs[variableID];
+    terms.clear();
+    for (const auto &[dep, weight]: dependencies[variableID]) {
+        ++terms[weight * variables[dep]];
+    }
+}
+
+template<typename Values>
+auto VariableSystem::aggregate(const size_t variableID, const Values &values) const -> Value {
+    const auto &deps = dependencies[variableID];
+    const auto term = [&values](const Edge &dep) { return dep.weight * values[dep.id]; };
+    switch (aggregations[variableID]) {
+        case Aggregation::Sum:
+        case Aggregation::Average: {
+            // a second cursor runs prefetchDistance inputs ahead and requests their values early
+            auto ahead = deps.cbegin();
+            for (size_t step = 0; step < options.prefetchDistance && ahead != deps.cend(); ++step, ++ahead) {
+                __builtin_prefetch(&values[(*ahead).id]);
+            }
+            auto partialSum = Value{0};
+            for (const auto &dep: deps) {
+                if (ahead != deps.cend()) {
+                    __builtin_prefetch(&values[(*ahead).id]);
+                    ++ahead;
+                }
+                partialSum += term(dep);
+            }
+            return partialSum;
+        }
+        case Aggregation::Min:
+            return term(*std::min_element(deps.cbegin(), deps.cend(), [&](const auto &lhs, const auto &rhs) {
+                return term(lhs) < term(rhs);
+            }));
+        case Aggregation::Max:
+            return term(*std::max_element(deps.cbegin(), deps.cend(), [&](const auto &lhs, const auto &rhs) {
+                return term(lhs) < term(rhs);
+            }));
+        case Aggregation::CountNonZero:
+            return static_cast<Value>(std::count_if(deps.cbegin(), deps.cend(),
+                                                    [&](const Edge &dep) { return term(dep) != 0; }));
+    }
+    return 0;
+}
+
+auto VariableSystem::refresh(const size_t variableID) -> Value { // NOLINT(*-no-recursion)
+    if (!stale[variableID].load(std::memory_order_relaxed)) {
+        return variables[variableID];
+    }
+    for (const auto &[dep, _]: dependencies[variableID]) {
+        [[maybe_unused]] const auto inputValue = refresh(dep);
+    }
+    variables[variableID] = aggregate(variableID, variables);
+    stale[variableID].store(false, std::memory_order_relaxed);
+    return variables[variableID];
+}
+
+auto VariableSystem::resolveStaleValues() const -> ValueVector {
+    auto values = variables;
+    for (const auto id: topologicalOrder) {
+        if (stale[id].load(std::memory_order_relaxed)) {
+            values[id] = aggregate(id, values);
+        }
+    }
+    return values;
+}
+
+auto VariableSystem::readVariable(const size_t variableID) -> Value {
+    assert(variableID < visibleSize && "Trying to read a variable that is not part of the system");
+    metrics.add(Metrics::Counter::Reads);
+    const auto adaptive = options.propagation == PropagationMode::Adaptive;
+    if (!lazy[variableID].load(std::memory_order_relaxed)) {
+        const std::shared_lock lockGuard(locks[variableID]);
+        // the flag only flips under every lock, so it is stable now; it may have flipped before the lock was taken
+        if (!lazy[variableID].load(std::memory_order_relaxed)) {
+            accessStatistics[variableID].reads.fetch_add(adaptive, std::memory_order_relaxed);
+            return variables[variableID];
+        }
     }
-    return mutexVector;
+    // every primary that could mark part of the support stale is locked, so the recomputation sees no writes
+    auto support = search(static_cast<VariableId>(variableID), dependencies);
+    std::sort(support.begin(), support.end(),
+              [this](VariableId lhs, VariableId rhs) { return ranks[lhs] < ranks[rhs]; });
+    std::vector<std::unique_lock<VariableLock>> lockGuards;
+    lockGuards.reserve(support.size());
+    for (const auto id: support) {
+        lockGuards.emplace_back(locks[id]);
+    }
+    accessStatistics[variableID].reads.fetch_add(adaptive, std::memory_order_relaxed);
+    return refresh(variableID);
 }
 
-auto VariableSystem::createVariables() const -> std::vector<int> {
-    std::vector<int> variableVector;
+auto VariableSystem::setPrimary(const size_t variableID, const Value newValue, const uint64_t sequence) -> SetOutcome {
+    assert(variableID < visibleSize && "Trying to set a variable that is not part of the system");
+    assert(dependencies[variableID].empty() && "Trying to set a non-primary variable");
+    auto &mailbox = mailboxes[variableID];
+    {
+        const std::lock_guard lockGuard(mailbox.lock);
+        if (sequence < mailbox.nextSequence) {
+            metrics.add(Metrics::Counter::PrimarySetsStale);
+            return SetOutcome::Stale;
+        }
+        mailbox.nextSequence = sequence + 1;
+        if (mailbox.pending) {
+            metrics.add(Metrics::Counter::PrimarySetsSuperseded);
+        } else {
+            metrics.adjust(Metrics::Gauge::PendingPrimarySets, 1);
+        }
+        mailbox.pending = true;
+        mailbox.pendingValue = newValue;
+        if (mailbox.draining) {
+            return SetOutcome::Queued;
+        }
+        mailbox.draining = true;
+    }
+    // whatever was set while a value propagated is applied next; values superseded in the meantime never are
+    while (true) {
+        auto value = Value{0};
+        {
+            const std::lock_guard lockGuard(mailbox.lock);
+            if (!mailbox.pending) {
+                mailbox.draining = false;
+                return SetOutcome::Applied;
+            }
+            mailbox.pending = false;
+            value = mailbox.pendingValue;
+        }
+        metrics.adjust(Metrics::Gauge::PendingPrimarySets, -1);
+        updateVariable(variableID, value, true);
+    }
+}
+
+auto VariableSystem::createLocks() const -> HugePageVector<VariableLock> {
+    // locks cannot move, so the vector is sized once and never grows
+    return HugePageVector<VariableLock>(size);
+}
+
+auto VariableSystem::createVariables() const -> ValueVector {
+    ValueVector variableVector;
     variableVector.resize(size, 0);
     return variableVector;
 }
 
+auto VariableSystem::createClock() const -> std::shared_ptr<Clock> {
+    if (options.seed) {
+        randomGenerator().seed(static_cast<std::mt19937::result_type>(*options.seed));
+    }
+    return options.clock ? options.clock : std::make_shared<SteadyClock>();
+}
+
+auto VariableSystem::createHistories() const -> std::vector<ValueHistory> {
+    if (!options.history) {
+        return {};
+    }
+    // every history starts with the initial value, so earlier times read as that
+    std::vector<ValueHistory> result(size, ValueHistory(options.historyCheckpoints));
+    const auto now = clock->now();
+    for (VariableId id = 0; id < size; ++id) {
+        if (dependencies[id].empty()) {
+            result[id].append(now, variables[id]);
+        }
+    }
+    return result;
+}
+
+void VariableSystem::recordHistory(const size_t primaryID) {
+    if (histories.empty()) {
+        return;
+    }
+    // the caller holds the primary's lock, so the entries of one primary are in commit order
+    const std::lock_guard lockGuard(historyLocks[primaryID]);
+    histories[primaryID].append(clock->now(), variables[primaryID]);
+}
+
+auto VariableSystem::evaluateAt(const std::vector<VariableId> &targets, const TimePoint time) const -> SparseValues {
+    // the union of the targets' supports, evaluated inputs first; only primaries come from the logs
+    std::vector<VariableId> support;
+    std::vector<VariableId> stack(targets);
+    SparseValues result;
+    while (!stack.empty()) {
+        const auto id = stack.back();
+        stack.pop_back();
+        if (!result.values.emplace(id, 0).second) { continue; }
+        support.push_back(id);
+        for (const auto &[input, _]: dependencies[id]) {
+            stack.push_back(input);
+        }
+    }
+    std::sort(support.begin(), support.end(),
+              [this](VariableId lhs, VariableId rhs) { return ranks[lhs] < ranks[rhs]; });
+    for (const auto id: support) {
+        if (dependencies[id].empty()) {
+            const std::shared_lock lockGuard(historyLocks[id]);
+            result.values[id] = histories[id].valueAt(time);
+        } else {
+            result.values[id] = aggregate(id, result);
+        }
+    }
+    return result;
+}
+
+auto VariableSystem::valueAt(const size_t variableID, const TimePoint time) const -> Value {
+    assert(variableID < visibleSize && "Trying to read a variable that is not part of the system");
+    assert(!histories.empty() && "Reading past values needs the history option");
+    return evaluateAt({static_cast<VariableId>(variableID)}, time)[variableID];
+}
+
+auto VariableSystem::diff(const TimePoint from, const TimePoint to) const -> std::vector<Change> {
+    assert(!histories.empty() && "Reading past values needs the history option");
+    // only the closures of primaries whose values differ can have changed
+    std::vector<bool> candidate(size, false);
+    for (const auto primary: primaries) {
+        auto before = Value{0};
+        auto after = Value{0};
+        {
+            const std::shared_lock lockGuard(historyLocks[primary]);
+            before = histories[primary].valueAt(from);
+            after = histories[primary].valueAt(to);
+        }
+        if (before == after) { continue; }
+        const auto handle = closureOf(primary, ClosureUse::Scan);
+        for (const auto &[id, _]: handle.closure) {
+            candidate[id] = true;
+        }
+    }
+    std::vector<VariableId> targets;
+    for (VariableId id = 0; id < visibleSize; ++id) {
+        if (candidate[id]) {
+            targets.push_back(id);
+        }
+    }
+    const auto before = evaluateAt(targets, from);
+    const auto after = evaluateAt(targets, to);
+    std::vector<Change> changes;
+    for (const auto id: targets) {
+        if (before[id] != after[id]) {
+            changes.push_back({id, before[id], after[id]});
+        }
+    }
+    return changes;
+}
+
+void VariableSystem::verifyHistory() const {
+    // run once the workers are gone: the present reconstructed from the logs must match the live values
+    const auto now = clock->now();
+    const auto currentValues = resolveStaleValues();
+    std::vector<VariableId> visible(visibleSize);
+    std::iota(visible.begin(), visible.end(), 0);
+    const auto reconstructed = evaluateAt(visible, now);
+    size_t entries = 0;
+    size_t bytes = 0;
+    for (const auto primary: primaries) {
+        entries += histories[primary].size();
+        bytes += histories[primary].memoryUsage();
+    }
+    for (const auto id: visible) {
+        if (!approximatelyEqual(reconstructed[id], currentValues[id])) {
+            metrics.add(Metrics::Counter::ConsistencyFailures);
+            assert(false && "Value reconstructed from the history differs from the live value");
+        }
+    }
+    std::cout << "HISTORY = " << entries << " values in " << bytes << " bytes, "
+              << diff(TimePoint{}, now).size() << " visible variables changed over the history retained\n";
+}
+
 auto VariableSystem::getAllDependents(size_t variableID) const -> std::set<size_t> {
     assert(variableID < size && "Trying to read dependents of a variable that is not part of the system");
-    const auto vector = search(variableID, dependents);
+    const auto vector = search(static_cast<VariableId>(variableID), dependents);
     return {vector.cbegin(), vector.cend()};
 }
 
-void VariableSystem::updateVariable(size_t variableId, int delta) { // NOLINT(*-easily-swappable-parameters)
+void VariableSystem::updateVariable(size_t variableId, Value change, // NOLINT(*-easily-swappable-parameters)
+                                    const bool isNewValue) {
     assert(variableId < size && "Trying to update a variable that is not part of the system");
     assert(dependencies[variableId].empty() && "Trying to update a non-primary variable");
-    const auto variablesDependents = getAllDependents(variableId);
-    std::vector<std::unique_lock<std::mutex>> lockGuards;
-    lockGuards.reserve(variablesDependents.size());
-    for (const auto dep: variablesDependents) {
-        lockGuards.emplace_back(*locks[dep]);
+    const auto handle = closureOf(variableId, ClosureUse::Update);
+    const auto &closure = handle.closure;
+    metrics.adjust(Metrics::Gauge::UpdatesWaitingForLocks, 1);
+    const auto updateStart = clock->now();
+    if (options.propagation == PropagationMode::Lazy) {
+        const std::lock_guard lockGuard(locks[variableId]);
+        recordLockWait(variableId, updateStart, 1);
+        variables[variableId] = isNewValue ? change : variables[variableId] + change;
+        for (const auto &[id, _]: closure) {
+            if (id != variableId) {
+                stale[id].store(true, std::memory_order_relaxed);
+            }
+        }
+        recordHistory(variableId);
+        recordCommit(updateStart);
+        return;
+    }
+    // the plan runs as three tight loops over runs of ranks: lock, apply, unlock. The targets are known up front,
+    // so a cursor running prefetchDistance ranks ahead, across runs, fetches the lock words and values early
+    const auto distance = options.prefetchDistance;
+    const auto &plan = handle.plan;
+    PropagationPlans::RankCursor lockAhead(plan.locks(), distance);
+    for (const auto &instruction: plan.locks()) {
+        const auto runEnd = instruction.firstRank + instruction.length;
+        for (auto rank = instruction.firstRank; rank < runEnd; ++rank) {
+            if (distance && !lockAhead.done()) {
+                __builtin_prefetch(&locks[topologicalOrder[lockAhead.rank()]], 1);
+                lockAhead.advance();
+            }
+            locks[topologicalOrder[rank]].lock();
+        }
+    }
+    recordLockWait(variableId, updateStart, closure.size());
+    // a new value only becomes a delta once the primary is locked, so concurrent updates cannot slip in between
+    const auto delta = isNewValue ? change - variables[variableId] : change;
+    if (!linearClosures[variableId]) {
+        propagateThroughAggregates(closure, delta);
+    }
+    const auto adaptive = options.propagation == PropagationMode::Adaptive;
+    const auto checksummed = !checksumCoefficients.empty();
+    auto checksumChange = Value{0};
+    auto checksumMagnitude = Value{0};
+    PropagationPlans::RankCursor applyAhead(plan.applies(), distance);
+    for (const auto &instruction: plan.applies()) {
+        const auto runEnd = instruction.firstRank + instruction.length;
+        const auto runDelta = delta * handle.plans->multiplier(instruction);
+        for (auto rank = instruction.firstRank; rank < runEnd; ++rank) {
+            if (distance && !applyAhead.done()) {
+                __builtin_prefetch(&variables[topologicalOrder[applyAhead.rank()]], 1);
+                applyAhead.advance();
+            }
+            const auto id = topologicalOrder[rank];
+            accessStatistics[id].writes += adaptive;
+            if (lazy[id].load(std::memory_order_relaxed)) {
+                stale[id].store(true, std::memory_order_relaxed);
+                continue;
+            }
+            const auto previousValue = variables[id];
+            variables[id] += runDelta;
+            if (checksummed) {
+                // what was actually written, so a wrong or lost write shows up as a checksum mismatch
+                const auto change = checksumCoefficients[id] * (variables[id] - previousValue);
+                checksumChange += change;
+                checksumMagnitude += std::abs(change);
+            }
+//            std::osyncstream(std::cout) << "[Thread " << std::this_thread::get_id() << "] Update #" << id << " by "
+//                                        << runDelta << '\n';
+            // force a yield; a virtual clock lets the time pass without handing over, as the locks are still held
+            clock->stall(std::chrono::milliseconds(1));
+        }
     }
-    for (const auto id: search(variableId, dependents)) {
-        variables[id] += delta;
-//        std::osyncstream(std::cout) << "[Thread " << std::this_thread::get_id() << "] Update #" << id << " by "
-//                                    << delta << '\n';
-        // force a yield
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (checksummed) {
+        recordChecksumChange(checksumChange, checksumMagnitude);
+    }
+    recordHistory(variableId);
+    // releasing in rank order is as safe as in reverse, and is what lets plans share their tails
+    for (const auto &instruction: plan.locks()) {
+        for (auto rank = instruction.firstRank; rank < instruction.firstRank + instruction.length; ++rank) {
+            locks[topologicalOrder[rank]].unlock();
+        }
+    }
+    recordCommit(updateStart);
+}
+
+void VariableSystem::recordLockWait(const size_t primaryID, const std::chrono::steady_clock::time_point start,
+                                    const size_t lockCount) {
+    const auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(clock->now() - start);
+    auto &statistics = primaryStatistics[primaryID];
+    statistics.updates.fetch_add(1, std::memory_order_relaxed);
+    statistics.lockWaitNanoseconds.fetch_add(waited.count(), std::memory_order_relaxed);
+    metrics.observe(Metrics::Histogram::LockWaitNanoseconds, waited.count());
+    metrics.observe(Metrics::Histogram::ClosureSize, lockCount);
+    metrics.adjust(Metrics::Gauge::UpdatesWaitingForLocks, -1);
+}
+
+void VariableSystem::recordCommit(const std::chrono::steady_clock::time_point start) {
+    const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(clock->now() - start);
+    metrics.observe(Metrics::Histogram::UpdateLatencyNanoseconds, latency.count());
+    metrics.add(Metrics::Counter::UpdatesCommitted);
+}
+
+void VariableSystem::applyInputChange(const size_t variableID, const InputChange &change) {
+    switch (aggregations[variableID]) {
+        case Aggregation::Sum:
+        case Aggregation::Average:
+            variables[variableID] += change.newTerm - change.oldTerm;
+            return;
+        case Aggregation::Min:
+        case Aggregation::Max: {
+            auto &terms = orderedInputs[variableID];
+            const auto old = terms.find(change.oldTerm);
+            assert(old != terms.end() && "Input term missing from the ordered inputs of a secondary");
+            if (!--old->second) {
+                terms.erase(old);
+            }
+            ++terms[change.newTerm];
+            variables[variableID] = aggregations[variableID] == Aggregation::Min ? terms.cbegin()->first
+                                                                                 : terms.crbegin()->first;
+            return;
+        }
+        case Aggregation::CountNonZero:
+            variables[variableID] += static_cast<Value>(change.newTerm != 0) - static_cast<Value>(change.oldTerm != 0);
+            return;
+    }
+}
+
+void VariableSystem::propagateThroughAggregates(const SharedRunAdjacency::Row &closure, const Value delta) {
+    // the closure is in topological order, so all changes to a variable's inputs are known by the time it is reached
+    std::unordered_map<VariableId, std::vector<InputChange>> pendingChanges;
+    const auto adaptive = options.propagation == PropagationMode::Adaptive;
+    const auto checksummed = !checksumCoefficients.empty();
+    auto checksumChange = Value{0};
+    auto checksumMagnitude = Value{0};
+    for (const auto &[id, _]: closure) {
+        accessStatistics[id].writes += adaptive;
+        if (lazy[id].load(std::memory_order_relaxed)) {
+            // only lazy variables depend on lazy ones, so nothing eager is waiting for this variable's new value
+            stale[id].store(true, std::memory_order_relaxed);
+            pendingChanges.erase(id);
+            continue;
+        }
+        const auto oldValue = variables[id];
+        if (dependencies[id].empty()) {
+            variables[id] += delta;
+        } else {
+            const auto pending = pendingChanges.find(id);
+            if (pending == pendingChanges.end()) { continue; /* no input of this variable changed */ }
+            for (const auto &change: pending->second) {
+                applyInputChange(id, change);
+            }
+            pendingChanges.erase(pending);
+        }
+        const auto newValue = variables[id];
+        if (newValue == oldValue) { continue; }
+        if (checksummed) {
+            checksumChange += checksumCoefficients[id] * (newValue - oldValue);
+            checksumMagnitude += std::abs(checksumCoefficients[id] * (newValue - oldValue));
+        }
+        for (const auto &[dependent, weight]: dependents[id]) {
+            pendingChanges[dependent].push_back({weight * oldValue, weight * newValue});
+        }
+        // force a yield; a virtual clock lets the time pass without handing over, as the locks are still held
+        clock->stall(std::chrono::milliseconds(1));
+    }
+    if (checksummed) {
+        recordChecksumChange(checksumChange, checksumMagnitude);
     }
 }
 
 void VariableSystem::checkConsistency() const {
-    std::vector<std::unique_lock<std::mutex>> lockGuards;
+    const auto checkStart = clock->now();
+    // shared mode: checkers and point readers do not exclude each other, only updates
+    std::vector<std::shared_lock<VariableLock>> lockGuards;
     lockGuards.reserve(variables.size());
-    for (const auto &lock: locks) {
-        lockGuards.emplace_back(*lock);
+    for (const auto id: topologicalOrder) {
+        lockGuards.emplace_back(locks[id]);
     }
 //    std::osyncstream(std::cout) << "[CC] Starting\n";
+    // stale variables hold no claim to be up to date, but the inputs of the others may still be stale
+    ValueVector resolvedValues;
+    if (options.propagation != PropagationMode::Eager) {
+        resolvedValues = resolveStaleValues();
+    }
+    const auto &currentValues = options.propagation != PropagationMode::Eager ? resolvedValues : variables;
     for (int index = 0; index < size; ++index) {
-        if (dependencies[index].empty()) { continue; }
-        const auto expectedValue = std::accumulate(dependencies[index].cbegin(),
-                                                   dependencies[index].cend(),
-                                                   0,
-                                                   [&](int partialSum, int valueId) {
-                                                       return partialSum + variables[valueId];
-                                                   });
+        if (dependencies[index].empty() || stale[index].load(std::memory_order_relaxed)) { continue; }
+        const auto expectedValue = aggregate(index, currentValues);
         const auto actualValue = variables[index];
-        if (expectedValue != actualValue) {
+        if (!approximatelyEqual(expectedValue, actualValue)) {
 //            std::osyncstream(std::cout) << "[CC] Failure when checking consistency for variable " << index << ":\n"
 //                                        << "Expected: " << expectedValue << " but got " << actualValue << '\n'
 //                                        << variablesAsString() << '\n';
+            metrics.add(Metrics::Counter::ConsistencyFailures);
             assert(false);
         }
     }
 //    std::osyncstream(std::cout) << "[CC] Success:\n" << variablesAsString() << '\n';
+    if (!checksumCoefficients.empty()) {
+        rebaseChecksum();
+    }
+    for (auto &sampled: sampledSinceFullCheck) {
+        sampled.store(false, std::memory_order_relaxed);
+    }
+    samplingTicksSinceFullCheck.store(0, std::memory_order_relaxed);
+    metrics.add(Metrics::Counter::ConsistencyChecks);
+    metrics.observe(Metrics::Histogram::CheckNanoseconds,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            clock->now() - checkStart).count());
+}
+
+auto VariableSystem::collectPrimaries() const -> std::vector<VariableId> {
+    std::vector<VariableId> result;
+    for (const auto id: topologicalOrder) {
+        if (dependencies[id].empty()) {
+            result.push_back(id);
+        }
+    }
+    return result;
+}
+
+auto VariableSystem::collectSecondaries() const -> std::vector<VariableId> {
+    std::vector<VariableId> result;
+    for (VariableId id = 0; id < size; ++id) {
+        if (!dependencies[id].empty()) {
+            result.push_back(id);
+        }
+    }
+    return result;
+}
+
+auto VariableSystem::computeChecksumCoefficients() const -> std::vector<Value> {
+    // lazy variables are written by reads, not by updates, so updates could not keep the checksum
+    if (!options.checksum || options.propagation != PropagationMode::Eager) {
+        return {};
+    }
+    // a secondary is linear in the primaries if it is a sum or average of primaries and such secondaries only;
+    // its value is then exactly the sum of W(p, s) * x_p
+    std::vector<bool> linearInPrimaries(size, false);
+    std::vector<Value> coefficients(size, 0);
+    for (const auto id: topologicalOrder) {
+        if (dependencies[id].empty()) {
+            linearInPrimaries[id] = true;
+            continue;
+        }
+        linearInPrimaries[id] = isLinear(aggregations[id]) &&
+                                std::all_of(dependencies[id].cbegin(), dependencies[id].cend(),
+                                            [&linearInPrimaries](const Edge &dep) {
+                                                return linearInPrimaries[dep.id];
+                                            });
+        if (linearInPrimaries[id]) {
+            coefficients[id] = static_cast<Value>(random() % CHECKSUM_COEFFICIENT_RANGE + 1);
+        }
+    }
+    return coefficients;
+}
+
+auto VariableSystem::computePrimaryChecksumWeights() const -> std::vector<Value> {
+    if (checksumCoefficients.empty()) {
+        return {};
+    }
+    std::vector<Value> weights(size, 0);
+    for (const auto primary: primaries) {
+        const auto handle = closureOf(primary, ClosureUse::Scan);
+        for (const auto &[id, effectiveWeight]: handle.closure) {
+            weights[primary] += checksumCoefficients[id] * effectiveWeight;
+        }
+    }
+    return weights;
+}
+
+void VariableSystem::recordChecksumChange(const Value change, const Value magnitude) {
+    thread_local const auto shardIndex = static_cast<size_t>(random()) % CHECKSUM_SHARD_COUNT;
+    auto &shard = checksumShards[shardIndex];
+    shard.sum.fetch_add(change, std::memory_order_relaxed);
+    shard.magnitude.fetch_add(magnitude, std::memory_order_relaxed);
+}
+
+auto VariableSystem::verifyChecksum() const -> bool {
+    // with every primary locked no update is in flight, so the shards and the primaries describe the same moment
+    std::vector<std::shared_lock<VariableLock>> lockGuards;
+    lockGuards.reserve(primaries.size());
+    for (const auto id: primaries) {
+        lockGuards.emplace_back(locks[id]);
+    }
+    auto expected = Value{0};
+    for (const auto id: primaries) {
+        expected += primaryChecksumWeights[id] * variables[id];
+    }
+    auto actual = Value{0};
+    auto magnitude = Value{0};
+    for (const auto &shard: checksumShards) {
+        actual += shard.sum.load(std::memory_order_relaxed);
+        magnitude += shard.magnitude.load(std::memory_order_relaxed);
+    }
+    metrics.add(Metrics::Counter::ChecksumChecks);
+    return std::abs(expected - actual) <= CONSISTENCY_RELATIVE_TOLERANCE * std::max({Value{1}, magnitude,
+                                                                                     std::abs(expected)});
+}
+
+void VariableSystem::rebaseChecksum() const {
+    // called under every lock by a full check that passed; drops the rounding error accumulated so far
+    auto sum = Value{0};
+    for (const auto id: secondaries) {
+        sum += checksumCoefficients[id] * variables[id];
+    }
+    for (auto &shard: checksumShards) {
+        shard.sum.store(0, std::memory_order_relaxed);
+        shard.magnitude.store(0, std::memory_order_relaxed);
+    }
+    checksumShards.front().sum.store(sum, std::memory_order_relaxed);
+    checksumShards.front().magnitude.store(std::abs(sum), std::memory_order_relaxed);
+}
+
+auto VariableSystem::computeCheckSampleSize() const -> size_t {
+    if (options.checkConfidence <= 0 || secondaries.empty()) {
+        return 0;
+    }
+    // checker ticks are CC_MAX_SLEEP_TIME_MS / 2 apart on average; solve 1 - (1 - k / S)^ticks >= confidence for k
+    const auto ticks = std::max(1.0, options.fullCheckInterval /
+                                     std::chrono::duration<double, std::milli>(CC_MAX_SLEEP_TIME_MS / 2.0));
+    const auto fraction = 1 - std::pow(1 - std::min(options.checkConfidence, 1.0), 1 / ticks);
+    return std::clamp<size_t>(static_cast<size_t>(std::ceil(fraction * static_cast<double>(secondaries.size()))),
+                              1, secondaries.size());
+}
+
+auto VariableSystem::sampleConsistency() const -> bool {
+    std::vector<VariableId> lockSet;
+    for (size_t sample = 0; sample < checkSampleSize; ++sample) {
+        const auto id = secondaries[random() % secondaries.size()];
+        // only the secondary and its inputs are locked, in rank order like every other lock set
+        lockSet.assign(1, id);
+        for (const auto &[input, _]: dependencies[id]) {
+            lockSet.push_back(input);
+        }
+        std::sort(lockSet.begin(), lockSet.end(),
+                  [this](VariableId lhs, VariableId rhs) { return ranks[lhs] < ranks[rhs]; });
+        lockSet.erase(std::unique(lockSet.begin(), lockSet.end()), lockSet.end());
+        std::vector<std::shared_lock<VariableLock>> lockGuards;
+        lockGuards.reserve(lockSet.size());
+        for (const auto lockedId: lockSet) {
+            lockGuards.emplace_back(locks[lockedId]);
+        }
+        sampledSinceFullCheck[id].store(true, std::memory_order_relaxed);
+        // a stale secondary holds no claim; a fresh one was computed from the values its inputs still hold, since
+        // recomputing an input would have made it stale
+        if (stale[id].load(std::memory_order_relaxed)) { continue; }
+        if (!approximatelyEqual(aggregate(id, variables), variables[id])) {
+            return false;
+        }
+    }
+    samplingTicksSinceFullCheck.fetch_add(1, std::memory_order_relaxed);
+    metrics.add(Metrics::Counter::SampledChecks);
+    metrics.add(Metrics::Counter::SampledSecondaries, checkSampleSize);
+    return true;
+}
+
+auto VariableSystem::detectionProbability(const uint64_t ticks) const -> double {
+    return 1 - std::pow(1 - static_cast<double>(checkSampleSize) / static_cast<double>(secondaries.size()),
+                        static_cast<double>(ticks));
+}
+
+void VariableSystem::reportCheckCoverage() const {
+    if (!checkSampleSize) {
+        return;
+    }
+    const auto covered = std::count_if(sampledSinceFullCheck.cbegin(), sampledSinceFullCheck.cend(),
+                                       [](const std::atomic<bool> &sampled) {
+                                           return sampled.load(std::memory_order_relaxed);
+                                       });
+    const auto ticks = samplingTicksSinceFullCheck.load(std::memory_order_relaxed);
+    std::osyncstream(std::cout)
+            << "[Check] " << ticks << " sampled ticks since the last full check, "
+            << 100.0 * static_cast<double>(covered) / static_cast<double>(secondaries.size())
+            << "% of secondaries covered, " << 100 * detectionProbability(ticks)
+            << "% chance of having caught a lasting inconsistency\n";
+}
+
+void VariableSystem::adaptPropagation() {
+    std::vector<std::unique_lock<VariableLock>> lockGuards;
+    lockGuards.reserve(variables.size());
+    for (const auto id: topologicalOrder) {
+        lockGuards.emplace_back(locks[id]);
+    }
+    std::vector<bool> wantsLazy(size, false);
+    std::vector<bool> wasLazy(size, false);
+    for (int index = 0; index < size; ++index) {
+        if (dependencies[index].empty()) { continue; }
+        auto &statistics = accessStatistics[index];
+        statistics.readRate = ACCESS_RATE_SMOOTHING * statistics.reads.exchange(0, std::memory_order_relaxed) +
+                              (1 - ACCESS_RATE_SMOOTHING) * statistics.readRate;
+        statistics.writeRate = ACCESS_RATE_SMOOTHING * statistics.writes +
+                               (1 - ACCESS_RATE_SMOOTHING) * statistics.writeRate;
+        statistics.writes = 0;
+        wasLazy[index] = lazy[index].load(std::memory_order_relaxed);
+        const auto writesPerRead = statistics.writeRate / std::max(statistics.readRate, 1.0);
+        wantsLazy[index] = wasLazy[index] ? writesPerRead > EAGER_WRITES_PER_READ
+                                                                       : writesPerRead > LAZY_WRITES_PER_READ;
+    }
+    // a variable may only be lazy if all its dependents are, so decide from the sinks upwards
+    for (auto it = topologicalOrder.crbegin(); it != topologicalOrder.crend(); ++it) {
+        const auto id = *it;
+        const auto becomesLazy = wantsLazy[id] &&
+                                 std::all_of(dependents[id].cbegin(), dependents[id].cend(),
+                                             [this](const Edge &dep) {
+                                                 return lazy[dep.id].load(std::memory_order_relaxed);
+                                             });
+        lazy[id].store(becomesLazy, std::memory_order_relaxed);
+    }
+    // variables turning eager must be brought up to date; their inputs are eager or refreshed just before them
+    for (const auto id: topologicalOrder) {
+        if (wasLazy[id] && !lazy[id].load(std::memory_order_relaxed)) {
+            [[maybe_unused]] const auto value = refresh(id);
+            rebuildOrderedInputs(id);
+        }
+    }
+}
+
+auto VariableSystem::computeAssignment(const std::vector<double> &loads, const std::vector<double> &contention,
+                                      const Assignment *previous) const -> std::shared_ptr<const Assignment> {
+    // greedy partitioning: the most contended primaries are placed first, each on the worker whose primaries'
+    // closures it overlaps most as long as that worker stays within its share of the load, else on the least
+    // loaded one; primaries that overlap nothing are thereby spread out
+    constexpr auto UNCLAIMED = std::numeric_limits<uint32_t>::max();
+    auto result = std::make_shared<Assignment>();
+    result->primariesByWorker.resize(THREAD_COUNT);
+    result->workerByPrimary.assign(size, UNCLAIMED);
+    std::vector<VariableId> primaries;
+    std::vector<size_t> closureSizes(size, 0);
+    auto totalLoad = 0.0;
+    for (VariableId id = 0; id < visibleSize; ++id) {
+        if (dependencies[id].empty()) {
+            primaries.push_back(id);
+            closureSizes[id] = closureOf(id, ClosureUse::Scan).closure.size();
+            totalLoad += loads[id];
+        }
+    }
+    std::stable_sort(primaries.begin(), primaries.end(),
+                     [&contention, &closureSizes](VariableId lhs, VariableId rhs) {
+                         return std::pair{contention[lhs], closureSizes[lhs]} >
+                                std::pair{contention[rhs], closureSizes[rhs]};
+                     });
+    const auto capacity = (1 + AFFINITY_IMBALANCE) * totalLoad / THREAD_COUNT;
+    std::vector<double> workerLoads(THREAD_COUNT, 0);
+    std::vector<size_t> overlaps(THREAD_COUNT);
+    std::vector<uint32_t> claimedBy(size, UNCLAIMED);
+    for (const auto primary: primaries) {
+        std::fill(overlaps.begin(), overlaps.end(), 0);
+        const auto handle = closureOf(primary, ClosureUse::Scan);
+        for (const auto &[id, _]: handle.closure) {
+            if (claimedBy[id] != UNCLAIMED) {
+                ++overlaps[claimedBy[id]];
+            }
+        }
+        // staying on the previous worker breaks ties, so rebalancing only moves primaries for a reason
+        const auto preference = [&](const uint32_t worker) {
+            const auto fits = workerLoads[worker] + loads[primary] <= capacity;
+            const auto stays = previous && previous->workerByPrimary[primary] == worker;
+            return std::tuple{fits, fits ? overlaps[worker] : 0, fits && stays, -workerLoads[worker]};
+        };
+        uint32_t best = 0;
+        for (uint32_t worker = 1; worker < THREAD_COUNT; ++worker) {
+            if (preference(worker) > preference(best)) {
+                best = worker;
+            }
+        }
+        for (const auto &[id, _]: handle.closure) {
+            if (claimedBy[id] == UNCLAIMED) {
+                claimedBy[id] = best;
+            }
+        }
+        result->primariesByWorker[best].push_back(primary);
+        result->workerByPrimary[primary] = best;
+        workerLoads[best] += loads[primary];
+    }
+    result->workerByVariable = std::move(claimedBy);
+    return result;
+}
+
+auto VariableSystem::createAssignment() const -> std::shared_ptr<const Assignment> {
+    if (!options.affinity) {
+        return nullptr;
+    }
+    // before anything is observed, every primary is as busy as the others and contends in proportion to how
+    // many other primaries' closures its own closure overlaps
+    std::vector<double> sharers(size, 0);
+    for (VariableId id = 0; id < visibleSize; ++id) {
+        if (dependencies[id].empty()) {
+            const auto handle = closureOf(id, ClosureUse::Scan);
+            for (const auto &[dependent, _]: handle.closure) {
+                ++sharers[dependent];
+            }
+        }
+    }
+    std::vector<double> loads(size, 1);
+    std::vector<double> contention(size, 0);
+    for (VariableId id = 0; id < visibleSize; ++id) {
+        if (dependencies[id].empty()) {
+            const auto handle = closureOf(id, ClosureUse::Scan);
+            for (const auto &[dependent, _]: handle.closure) {
+                contention[id] += sharers[dependent] - 1;
+            }
+        }
+    }
+    return computeAssignment(loads, contention, nullptr);
+}
+
+void VariableSystem::rebalanceAffinities() {
+    const auto current = assignment.load();
+    std::vector<double> loads(size, 0);
+    std::vector<double> contention(size, 0);
+    for (VariableId id = 0; id < visibleSize; ++id) {
+        if (!dependencies[id].empty()) { continue; }
+        auto &statistics = primaryStatistics[id];
+        statistics.updateRate = ACCESS_RATE_SMOOTHING * static_cast<double>(statistics.updates.exchange(0)) +
+                                (1 - ACCESS_RATE_SMOOTHING) * statistics.updateRate;
+        statistics.lockWaitRate =
+                ACCESS_RATE_SMOOTHING * static_cast<double>(statistics.lockWaitNanoseconds.exchange(0)) +
+                (1 - ACCESS_RATE_SMOOTHING) * statistics.lockWaitRate;
+        // a primary nobody has updated lately still has to belong to some worker
+        loads[id] = statistics.updateRate + 1;
+        contention[id] = statistics.lockWaitRate;
+    }
+    auto next = computeAssignment(loads, contention, current.get());
+    uint64_t migrated = 0;
+    for (VariableId id = 0; id < visibleSize; ++id) {
+        migrated += dependencies[id].empty() && next->workerByPrimary[id] != current->workerByPrimary[id];
+    }
+    metrics.add(Metrics::Counter::PrimariesMigrated, migrated);
+    // a worker still picking from the old assignment is harmless: affinity only spares lock waits
+    assignment.store(std::move(next));
+}
+
+auto VariableSystem::pickPrimary(const size_t workerIndex) const -> size_t {
+    const auto current = assignment.load();
+    if (current && !current->primariesByWorker[workerIndex].empty()) {
+        const auto &own = current->primariesByWorker[workerIndex];
+        return own[random() % own.size()];
+    }
+    // no affinity, or fewer primaries than workers
+    return random() % visibleSize;
+}
+
+auto VariableSystem::createWorkerCpus() const -> std::vector<Numa::Cpu> {
+    if (!options.pinThreads && options.placement != MemoryPlacement::Local) {
+        return {};
+    }
+    const auto allowed = Numa::cpus();
+    if (allowed.empty()) {
+        return {};
+    }
+    // proportional rather than consecutive, so fewer workers than CPUs still reach every node
+    std::vector<Numa::Cpu> result;
+    for (size_t worker = 0; worker < THREAD_COUNT; ++worker) {
+        result.push_back(allowed[worker * allowed.size() / THREAD_COUNT]);
+    }
+    return result;
+}
+
+template<typename T>
+auto VariableSystem::placeArray(HugePageVector<T> &array, const std::vector<int> &nodeByVariable) const -> size_t {
+    const auto bytes = array.size() * sizeof(T);
+    // smaller arrays are on the regular heap, not page aligned, and mostly in cache anyway
+    if (bytes < HugePages::MIN_BYTES) {
+        return 0;
+    }
+    auto *const base = reinterpret_cast<char *>(array.data());
+    if (nodeByVariable.empty()) {
+        return Numa::interleave(base, bytes) ? bytes : 0;
+    }
+    const auto nodeCount = static_cast<size_t>(*std::max_element(nodeByVariable.cbegin(), nodeByVariable.cend()) + 1);
+    std::vector<size_t> votes(nodeCount);
+    size_t placed = 0;
+    // a page goes where most of the variables on it are owned; elements straddling two pages vote for both
+    for (size_t offset = 0; offset < bytes; offset += HugePages::PAGE_SIZE) {
+        const auto length = std::min(HugePages::PAGE_SIZE, bytes - offset);
+        std::fill(votes.begin(), votes.end(), 0);
+        for (auto index = offset / sizeof(T); index < std::min((offset + length + sizeof(T) - 1) / sizeof(T), size);
+             ++index) {
+            if (nodeByVariable[index] >= 0) {
+                ++votes[nodeByVariable[index]];
+            }
+        }
+        const auto node = static_cast<int>(std::max_element(votes.cbegin(), votes.cend()) - votes.cbegin());
+        placed += Numa::bind(base + offset, length, node) ? length : 0;
+    }
+    return placed;
+}
+
+auto VariableSystem::placeMemory() -> size_t {
+    if (options.placement == MemoryPlacement::Default) {
+        return 0;
+    }
+    std::vector<int> nodeByVariable;
+    const auto current = assignment.load();
+    // without affinity nobody owns a variable, so local placement degrades to interleaving
+    if (options.placement == MemoryPlacement::Local && current && !workerCpus.empty()) {
+        nodeByVariable.resize(size, -1);
+        for (size_t id = 0; id < size; ++id) {
+            if (current->workerByVariable[id] < workerCpus.size()) {
+                nodeByVariable[id] = workerCpus[current->workerByVariable[id]].node;
+            }
+        }
+    }
+    return placeArray(variables, nodeByVariable) + placeArray(locks, nodeByVariable);
 }
 
 void VariableSystem::startThreads() {
-    const auto baseVariableCount = std::count_if(dependencies.cbegin(),
-                                                 dependencies.cend(),
-                                                 [](const auto &dependencyVector) { return dependencyVector.empty(); });
-    const auto workerThreadBody = [this]() {
+    const auto workerThreadBody = [this](const std::stop_token &stopToken, const size_t workerIndex) {
+        if (!workerCpus.empty()) {
+            Numa::pinCurrentThread(workerCpus[workerIndex].id);
+        }
+        clock->attach(workerIndex);
 //        std::osyncstream(std::cout) << "[Thread " << std::this_thread::get_id()
 //                                    << "] About to take a nap\n";
-        std::this_thread::sleep_for(
+        clock->sleepFor(
                 std::chrono::milliseconds(random() % WORKER_MAX_SLEEP_TIME_MS) +
                 std::chrono::milliseconds(WORKER_THREAD_MIN_INITIAL_SLEEP_MS));
-        for (auto i = 0; i < WORKER_ITER_COUNT; ++i) {
-            const auto variableId = random() % size;
+        // a stop request is only observed between updates, so every started update is drained
+        for (auto i = 0; options.service ? !stopToken.stop_requested() : i < WORKER_ITER_COUNT; ++i) {
+            if (random() % 100 < WORKER_READ_PERCENTAGE) {
+                [[maybe_unused]] const auto value = readVariable(random() % visibleSize);
+            }
+            const auto variableId = pickPrimary(workerIndex);
             if (!dependencies[variableId].empty()) {
                 --i /*stall 1 iteration*/;
                 continue;
             }
-            const auto delta = random() % UPDATE_VALUE_SPREAD - UPDATE_VALUE_MEAN;
-            if (!delta) {
-                --i /*stall 1 iteration*/;
-                continue;
+            if (random() % 100 < WORKER_SET_PERCENTAGE) {
+                // a notification carries a new absolute value, drawn like a delta, rather than the delta itself
+                const auto newValue = static_cast<Value>(random() % UPDATE_VALUE_SPREAD - UPDATE_VALUE_MEAN);
+                // the number is drawn before the call, so notifications for one primary can overtake each other
+                const auto sequence = notificationSequences[variableId].fetch_add(1, std::memory_order_relaxed);
+                [[maybe_unused]] const auto outcome = setPrimary(variableId, newValue, sequence);
+            } else {
+                const auto delta = random() % UPDATE_VALUE_SPREAD - UPDATE_VALUE_MEAN;
+                if (!delta) {
+                    --i /*stall 1 iteration*/;
+                    continue;
+                }
+                updateVariable(variableId, delta);
             }
-            updateVariable(variableId, delta);
-            std::this_thread::sleep_for(std::chrono::milliseconds(random() % WORKER_MAX_SLEEP_TIME_MS));
+            clock->sleepFor(std::chrono::milliseconds(random() % WORKER_MAX_SLEEP_TIME_MS));
         }
 //        std::osyncstream(std::cout) << "[Thread " << std::this_thread::get_id() << "] End\n";
+        clock->detach();
     };
-    const auto ccThreadBody = [this]() {
+    const auto ccThreadBody = [this](const std::stop_token &stopToken, const size_t checkerIndex) {
 //        std::osyncstream(std::cout) << "[CC Thread " << std::this_thread::get_id() << "] About to take a nap\n";
-        for (auto i = 0; i < CC_ITER_COUNT; ++i) {
-            checkConsistency();
-            std::this_thread::sleep_for(std::chrono::milliseconds(random() % CC_MAX_SLEEP_TIME_MS));
+        clock->attach(THREAD_COUNT + checkerIndex);
+        auto lastFullCheck = clock->now();
+        for (auto i = 0; options.service ? !stopToken.stop_requested() : i < CC_ITER_COUNT; ++i) {
+            // the full check confirms and counts whatever a failed screening found
+            const auto screened = !checksumCoefficients.empty() || checkSampleSize;
+            if (!screened || clock->now() - lastFullCheck >= options.fullCheckInterval ||
+                (!checksumCoefficients.empty() && !verifyChecksum()) || (checkSampleSize && !sampleConsistency())) {
+                checkConsistency();
+                lastFullCheck = clock->now();
+            }
+            if (checkerIndex) {
+                clock->sleepFor(std::chrono::milliseconds(random() % CC_MAX_SLEEP_TIME_MS));
+                continue;
+            }
+            if (options.propagation == PropagationMode::Adaptive) {
+                adaptPropagation();
+            }
+            if (options.affinity && i % REBALANCE_PERIOD == REBALANCE_PERIOD - 1) {
+                rebalanceAffinities();
+            }
+            if (!options.metricsPath.empty()) {
+                metrics.exportTo(options.metricsPath);
+            }
+            clock->sleepFor(std::chrono::milliseconds(random() % CC_MAX_SLEEP_TIME_MS));
         }
 //        std::osyncstream(std::cout) << "[CC Thread " << std::this_thread::get_id() << "] Ended\n";
+        clock->detach();
     };
 //    std::osyncstream(std::cout) << "[Main] Starting worker threads\n";
-    threads.reserve(THREAD_COUNT + 1);
-    for (int index = 0; index < THREAD_COUNT; ++index) {
-        threads.emplace_back(workerThreadBody);
+    threads.reserve(THREAD_COUNT + std::max<size_t>(options.checkerThreads, 1));
+    // workers, then checkers: fixed numbers, so a virtual clock schedules them the same way every run
+    clock->expect(THREAD_COUNT + std::max<size_t>(options.checkerThreads, 1));
+    for (size_t index = 0; index < THREAD_COUNT; ++index) {
+        threads.emplace_back(workerThreadBody, index);
+    }
+    for (size_t index = 0; index < std::max<size_t>(options.checkerThreads, 1); ++index) {
+        threads.emplace_back(ccThreadBody, index);
+    }
+    if (options.service) {
+        statsThread = std::jthread([this](const std::stop_token &stopToken) { reportStatistics(stopToken); });
+    }
+}
+
+void VariableSystem::reportStatistics(const std::stop_token &stopToken) const {
+    std::mutex mutex;
+    std::condition_variable_any wakeUp;
+    auto previousUpdates = metrics.total(Metrics::Counter::UpdatesCommitted);
+    auto previousLatency = metrics.snapshot(Metrics::Histogram::UpdateLatencyNanoseconds);
+    auto previousTime = clock->now();
+    std::unique_lock lock(mutex);
+    while (true) {
+        wakeUp.wait_for(lock, stopToken, options.statisticsInterval, [] { return false; });
+        if (stopToken.stop_requested()) { break; }
+        const auto updates = metrics.total(Metrics::Counter::UpdatesCommitted);
+        const auto latency = metrics.snapshot(Metrics::Histogram::UpdateLatencyNanoseconds);
+        const auto time = clock->now();
+        const auto window = latency - previousLatency;
+        const auto seconds = std::chrono::duration<double>(time - previousTime).count();
+        std::osyncstream(std::cout)
+                << "[Stats] " << static_cast<double>(updates - previousUpdates) / seconds << " updates/s, latency mean "
+                << (window.count ? static_cast<double>(window.sum) / static_cast<double>(window.count) / 1e3 : 0.0)
+                << " us, p50 <= " << static_cast<double>(Metrics::quantileUpperBound(
+                        Metrics::Histogram::UpdateLatencyNanoseconds, window, 0.5)) / 1e3
+                << " us, p99 <= " << static_cast<double>(Metrics::quantileUpperBound(
+                        Metrics::Histogram::UpdateLatencyNanoseconds, window, 0.99)) / 1e3 << " us\n";
+        previousUpdates = updates;
+        previousLatency = latency;
+        previousTime = time;
+        reportCheckCoverage();
     }
-    threads.emplace_back(ccThreadBody);
 }
 
 void VariableSystem::gatherThreads() {
+    if (options.service) {
+        std::mutex mutex;
+        std::condition_variable_any stopRequested;
+        std::unique_lock lock(mutex);
+        stopRequested.wait(lock, options.stopToken, [] { return false; });
+        std::osyncstream(std::cout) << "[Main] stop requested, draining in-flight updates\n";
+        for (auto &thread: threads) {
+            thread.request_stop();
+        }
+        statsThread.request_stop();
+    }
 //    std::osyncstream(std::cout) << "[Main] waiting for workers\n";
     for (auto &thread: threads) {
         if (thread.joinable()) {
@@ -212,5 +1532,16 @@ void VariableSystem::gatherThreads() {
         }
     }
 //    std::osyncstream(std::cout) << "[Main] gathered threads\n";
+    if (statsThread.joinable()) {
+        statsThread.join();
+    }
+    reportCheckCoverage();
+    reportClosureCache();
     checkConsistency();
+    if (!histories.empty()) {
+        verifyHistory();
+    }
+    if (!options.metricsPath.empty()) {
+        metrics.exportTo(options.metricsPath);
+    }
 }
@@ -5,20 +5,314 @@
 #ifndef LAB01_NONCOOPERATIVEMULTITHREADING_VARIABLESYSTEM_HPP
 #define LAB01_NONCOOPERATIVEMULTITHREADING_VARIABLESYSTEM_HPP
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <random>
 #include <set>
+#include <shared_mutex>
+#include <stop_token>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "Adjacency.hpp"
+#include "BoundedCache.hpp"
+#include "Clock.hpp"
+#include "HugePageAllocator.hpp"
+#include "Metrics.hpp"
+#include "Numa.hpp"
+#include "PlanCache.hpp"
+#include "PropagationPlans.hpp"
+#include "ValueHistory.hpp"
+#include "VariableLock.hpp"
+
+enum class PropagationMode {
+    /// updates write every variable in the primary's closure
+    Eager,
+    /// updates write only the primary and mark its dependents stale; secondaries are recomputed when read
+    Lazy,
+    /// each secondary is switched between eager and lazy maintenance from its observed read / write rates
+    Adaptive,
+};
+
+enum class MemoryPlacement {
+    /// wherever the pages were first touched, i.e. the node of the constructing thread
+    Default,
+    /// each page of the variables and locks goes to the node of the worker owning most of the variables on it;
+    /// implies pinned workers, whose nodes would be unknown otherwise
+    Local,
+    /// pages are spread round-robin over all nodes, for data that every worker touches
+    Interleaved,
+};
+
+struct VariableSystemOptions {
+    PropagationMode propagation = PropagationMode::Eager;
+    /// secondaries with more inputs are split into a balanced tree of hidden aggregation variables; 0 disables it
+    size_t maxFanIn = 64;
+    /// when set, metrics are written there in Prometheus text format after every consistency check
+    std::string metricsPath;
+    /// run the workload until stopToken is signalled instead of for a fixed number of iterations
+    bool service = false;
+    std::stop_token stopToken;
+    /// service mode only: how often throughput and latency over the last window are printed
+    std::chrono::milliseconds statisticsInterval{1000};
+    /// how many closure entries / inputs ahead values and locks are prefetched; 0 disables prefetching
+    size_t prefetchDistance = 8;
+    /// give each worker the updates of a set of primaries whose closures overlap, so conflicting updates queue up
+    /// in one thread instead of on the locks; the sets are rebalanced from the observed load and lock waits
+    bool affinity = true;
+    /// pin worker i to the i-th allowed CPU in node order, spreading the workers over the nodes
+    bool pinThreads = false;
+    MemoryPlacement placement = MemoryPlacement::Default;
+    /// consistency checkers running side by side; they only take locks in shared mode. The first one also
+    /// adapts propagation, rebalances affinities and exports metrics
+    size_t checkerThreads = 1;
+    /// when set, a checker tick verifies only enough random secondaries, each under the locks of itself and its
+    /// inputs, to catch a lasting inconsistency with this probability before the next full check
+    double checkConfidence = 0;
+    /// eager propagation only: screen every checker tick with a random-coefficient checksum over the secondaries
+    /// that are linear in the primaries, which only needs the primaries' locks and values
+    bool checksum = false;
+    /// log every value each primary takes, compressed, so that valueAt and diff can reconstruct the past
+    bool history = false;
+    /// history only: besides the values since its last checkpoint, each primary keeps its last historyCheckpoints
+    /// to twice as many segments of ValueHistory::CHECKPOINT_INTERVAL values, so a --service run stays bounded;
+    /// 0 keeps the whole run. Times before the oldest value retained read as that value
+    size_t historyCheckpoints = 1024;
+    /// sampling or checksum only: full checks still run this often, and right after any failed screening
+    std::chrono::milliseconds fullCheckInterval{10'000};
+    /// where threads read the time and sleep; a VirtualClock runs a fixed-length run in simulated time, one
+    /// thread at a time. Defaults to a SteadyClock
+    std::shared_ptr<Clock> clock;
+    /// seeds the workload's random numbers instead of std::random_device; with a VirtualClock it makes whole runs
+    /// reproducible
+    std::optional<uint64_t> seed;
+    /// when set, the structures derived from the graph are mapped from this file if it was saved for the same
+    /// graph, and computed and saved there otherwise
+    std::string planCachePath;
+    /// when non-zero, closures and their plans are not precomputed for every primary but compiled by a traversal
+    /// when an update first needs them, and kept in a cache of at most this many bytes that evicts the least
+    /// recently used; for graphs whose closures would not all fit in memory
+    size_t closureCacheBytes = 0;
+};
+
 class VariableSystem {
+public:
+    using Options = VariableSystemOptions;
+    using Value = double;
+    using Weight = double;
+    using ValueVector = HugePageVector<Value>;
+
+    /// One input edge of a secondary variable: the secondary receives `weight * variables[id]`
+    struct Dependency {
+        size_t id;
+        Weight weight = 1;
+    };
+
+    /// How a secondary combines its weighted input terms `weight * variables[id]`
+    enum class Aggregation {
+        Sum,
+        Min,
+        Max,
+        CountNonZero,
+        /// sum of the terms divided by the sum of the weights
+        Average,
+    };
+
+    /// A variable together with the way it is computed; primaries have no dependencies
+    struct Definition {
+        Aggregation aggregation = Aggregation::Sum;
+        std::vector<Dependency> dependencies;
+    };
+
+    using TimePoint = ValueHistory::TimePoint;
+
+    /// A variable whose value differs between the two times given to diff
+    struct Change {
+        size_t id;
+        Value before;
+        Value after;
+    };
+
+    /// What became of a value passed to setPrimary
+    enum class SetOutcome {
+        /// applied by this call, possibly followed by values other calls set meanwhile
+        Applied,
+        /// left for the call already applying values to this primary, which applies it unless a newer one comes
+        Queued,
+        /// dropped: a set with the same or a later sequence number was accepted before
+        Stale,
+    };
+
 private:
+    /// Tests.cpp inspects the consistency failures and drives propagation adaptation directly
+    friend class VariableSystemTests;
+
+    /// Accesses to a variable, counted under its lock and folded into moving averages by adaptPropagation;
+    /// reads hold the lock in shared mode, so they are counted atomically
+    struct AccessStatistics {
+        std::atomic<uint32_t> reads{0};
+        uint32_t writes = 0;
+        double readRate = 0;
+        double writeRate = 0;
+    };
+
+    /// Updates of one primary and the time they spent acquiring locks, folded into moving averages on rebalancing
+    struct PrimaryStatistics {
+        std::atomic<uint64_t> updates{0};
+        std::atomic<uint64_t> lockWaitNanoseconds{0};
+        double updateRate = 0;
+        double lockWaitRate = 0;
+    };
+
+    /// Which worker generates the updates of each primary; replaced as a whole when rebalancing
+    struct Assignment {
+        std::vector<std::vector<VariableId>> primariesByWorker;
+        /// indexed by variable id, only meaningful for primaries
+        std::vector<uint32_t> workerByPrimary;
+        /// the worker of the first primary placed whose closure contains the variable
+        std::vector<uint32_t> workerByVariable;
+    };
+
+    static constexpr size_t CHECKSUM_SHARD_COUNT = 64;
+
+    /// part of the graph key, bumped whenever a cached structure changes layout or meaning
+    static constexpr uint64_t CACHED_STRUCTURES_VERSION = 2;
+
+    /// The sections of a plan cache file
+    enum class CachedStructure : size_t {
+        Dependents,
+        TopologicalOrder,
+        Ranks,
+        Closures,
+        Plans,
+        Count,
+    };
+
+    /// One thread's share of the running checksum, on its own cache line
+    struct alignas(64) ChecksumShard {
+        std::atomic<Value> sum{0};
+        /// sum of the absolute changes, which bounds the rounding error accumulated in sum
+        std::atomic<Value> magnitude{0};
+    };
+
+    /// New values for one primary waiting to be applied; one caller at a time, the drainer, applies them
+    struct PrimaryMailbox {
+        VariableLock lock;
+        bool draining = false;
+        bool pending = false;
+        /// sets numbered below this are stale
+        uint64_t nextSequence = 0;
+        Value pendingValue = 0;
+    };
+
+    /// Values of a few variables, readable like a ValueVector by aggregate
+    struct SparseValues {
+        std::unordered_map<VariableId, Value> values;
+
+        auto operator[](const size_t id) const -> const Value & { return values.at(static_cast<VariableId>(id)); }
+    };
+
+    /// One primary's closure and plan, compiled on demand when closures are not precomputed
+    struct CompiledClosure {
+        SharedRunAdjacency closure;
+        PropagationPlans plans;
+    };
+
+    /// Who asks for a closure: updates fill the closure cache and count towards its hit rate, scans over every
+    /// primary only use what is cached, as they would otherwise flush it
+    enum class ClosureUse {
+        Update,
+        Scan,
+    };
+
+    /// A primary's closure and plan; compiled is what keeps them alive when they were compiled on demand
+    struct ClosureHandle {
+        std::shared_ptr<const CompiledClosure> compiled;
+        SharedRunAdjacency::Row closure;
+        PropagationPlans::Plan plan;
+        const PropagationPlans *plans;
+    };
+
+    /// The old and new value of one weighted input term of a secondary
+    struct InputChange {
+        Value oldTerm;
+        Value newTerm;
+    };
+
+    /// including hidden aggregation variables, which are numbered after the visible ones
     const size_t size;
-    std::vector<int> variables;
-    const std::vector<std::vector<size_t>> dependencies;
-    const std::vector<std::vector<size_t>> dependents;
-    std::vector<std::unique_ptr<std::mutex>> locks;
-    std::vector<std::thread> threads;
+    const size_t visibleSize;
+    const Options options;
+    const std::shared_ptr<Clock> clock;
+    const std::vector<Aggregation> aggregations;
+    ValueVector variables;
+    /// only scanned by checks and lazy recomputation, so kept delta-encoded
+    const EncodedAdjacency dependencies;
+    /// only open while the derived members below are initialised
+    std::optional<PlanCache> planCache;
+    const CompactAdjacency dependents;
+    const HugePageVector<VariableId> topologicalOrder;
+    const HugePageVector<VariableId> ranks;
+    /// per primary, every variable an update touches with the primary's total (path-summed) weight in it,
+    /// in topological order, which is also the order in which locks are taken; stored as runs of ranks with
+    /// shared tails. Empty when a closure cache is used instead
+    const SharedRunAdjacency closures;
+    /// whether every secondary in the primary's closure is a linear function of it (sums and averages only)
+    const std::vector<bool> linearClosures;
+    /// the closures as lock / apply / unlock instructions, which eager updates execute
+    const PropagationPlans plans;
+    /// the closures and plans most recently used by updates, when they are not precomputed; null otherwise
+    mutable std::unique_ptr<BoundedCache<VariableId, CompiledClosure>> closureCache;
+    /// counted multisets of the input terms of min / max secondaries, guarded by the secondary's lock
+    std::vector<std::map<Value, size_t>> orderedInputs;
+    /// whether the variable is recomputed on read instead of written by updates; the set of lazy variables is
+    /// closed under dependents, so eager variables only ever have eager inputs. Only changes under every lock
+    std::vector<std::atomic<bool>> lazy;
+    /// set by updates that skipped a lazy variable, cleared when a read recomputes it
+    std::vector<std::atomic<bool>> stale;
+    /// adaptive mode only
+    std::vector<AccessStatistics> accessStatistics;
+    mutable HugePageVector<VariableLock> locks;
+    /// indexed by variable id, only primaries are used
+    std::vector<PrimaryStatistics> primaryStatistics;
+    /// in rank order
+    const std::vector<VariableId> primaries;
+    const std::vector<VariableId> secondaries;
+    /// r_s: a random integer for each secondary that is a linear function of the primaries, 0 for any other
+    /// variable; empty when the checksum is off
+    const std::vector<Value> checksumCoefficients;
+    /// c_p: the sum of r_s * W(p, s) over the closure of primary p, with W the closure's path-summed weights
+    const std::vector<Value> primaryChecksumWeights;
+    /// together sum to G, the sum of r_s * v_s, which the updates maintain and the checker compares with
+    /// the sum of c_p * x_p over the primaries
+    mutable std::array<ChecksumShard, CHECKSUM_SHARD_COUNT> checksumShards;
+    /// secondaries verified by each sampling tick, 0 when every tick is a full check
+    const size_t checkSampleSize;
+    /// which secondaries a sample has verified since the last full check, and in how many ticks
+    mutable std::vector<std::atomic<bool>> sampledSinceFullCheck;
+    mutable std::atomic<uint64_t> samplingTicksSinceFullCheck{0};
+    /// indexed by variable id, only primaries are used
+    std::vector<PrimaryMailbox> mailboxes;
+    /// the simulated notification feed numbers the new values of each primary
+    std::vector<std::atomic<uint64_t>> notificationSequences;
+    /// indexed by variable id, only primaries are used; empty when the history is off. A history is appended
+    /// under both its primary's lock and its own, and read under its own
+    std::vector<ValueHistory> histories;
+    mutable std::vector<VariableLock> historyLocks;
+    /// null when affinity scheduling is off
+    std::atomic<std::shared_ptr<const Assignment>> assignment;
+    /// CPU of each worker, empty when workers are not pinned
+    const std::vector<Numa::Cpu> workerCpus;
+    std::vector<std::jthread> threads;
+    std::jthread statsThread;
+    mutable Metrics metrics;
 
     static constexpr int WORKER_ITER_COUNT = 50;
     static constexpr int CC_ITER_COUNT = 20;
@@ -28,32 +322,190 @@ private:
     static constexpr int UPDATE_VALUE_SPREAD = 20;
     static constexpr int UPDATE_VALUE_MEAN = 10;
     static constexpr int THREAD_COUNT = 7;
+    static constexpr int WORKER_READ_PERCENTAGE = 20;
+    /// share of worker updates that arrive as notifications of a new value instead of a delta
+    static constexpr int WORKER_SET_PERCENTAGE = 30;
+    static constexpr double ACCESS_RATE_SMOOTHING = 0.5;
+    /// hysteresis band: go lazy above this many writes per read, go back to eager below the second bound
+    static constexpr double LAZY_WRITES_PER_READ = 8;
+    static constexpr double EAGER_WRITES_PER_READ = 2;
+    static constexpr Value CONSISTENCY_RELATIVE_TOLERANCE = 1e-9;
+    /// consistency checks between two affinity rebalancings
+    static constexpr int REBALANCE_PERIOD = 5;
+    /// the coefficients are drawn from [1, CHECKSUM_COEFFICIENT_RANGE], small enough to keep the checksum exact
+    /// in a double for integer weights and deltas
+    static constexpr int CHECKSUM_COEFFICIENT_RANGE = 1 << 16;
+    /// how far above an even share of the load a worker may be filled with overlapping primaries
+    static constexpr double AFFINITY_IMBALANCE = 0.25;
 
     [[nodiscard]] static auto random() -> int;
 
+    [[nodiscard]] static auto randomGenerator() -> std::mt19937 &;
+
+    template<typename Adjacency>
+    [[nodiscard]] static auto search(VariableId startID, const Adjacency &searchSpace) -> std::vector<VariableId>;
+
+    [[nodiscard]] static auto
+    foldDuplicates(const std::vector<std::vector<size_t>> &deps) -> std::vector<std::vector<Dependency>>;
+
+    [[nodiscard]] static auto asSums(const std::vector<std::vector<Dependency>> &deps) -> std::vector<Definition>;
+
+    [[nodiscard]] static auto extractAggregations(const std::vector<Definition> &definitions) -> std::vector<Aggregation>;
+
     [[nodiscard]] static auto
-    search(size_t startID, const std::vector<std::vector<size_t>> &searchSpace) -> std::vector<size_t>;
+    extractDependencies(const std::vector<Definition> &definitions) -> std::vector<std::vector<Edge>>;
+
+    [[nodiscard]] static auto
+    restructure(const std::vector<Definition> &definitions, size_t maxFanIn) -> std::vector<Definition>;
+
+    [[nodiscard]] static auto isLinear(Aggregation aggregation) -> bool;
+
+    [[nodiscard]] static auto approximatelyEqual(Value expected, Value actual) -> bool;
 
     [[nodiscard]] auto variablesAsString() const -> std::string;
 
-    [[nodiscard]] auto computeDependents() const -> std::vector<std::vector<size_t>>;
+    /// identifies the graph a plan cache was saved for: the variables, their aggregations and inputs
+    [[nodiscard]] auto computeGraphKey() const -> uint64_t;
+
+    [[nodiscard]] auto openPlanCache() const -> std::optional<PlanCache>;
+
+    [[nodiscard]] auto savePlanCache() const -> bool;
+
+    [[nodiscard]] auto computeDependents() const -> CompactAdjacency;
+
+    [[nodiscard]] auto computeTopologicalOrder() const -> HugePageVector<VariableId>;
+
+    [[nodiscard]] auto computeRanks() const -> HugePageVector<VariableId>;
+
+    [[nodiscard]] auto computeClosure(VariableId primaryID) const -> std::vector<Edge>;
+
+    [[nodiscard]] auto computeClosures() const -> SharedRunAdjacency;
+
+    [[nodiscard]] auto computeLinearClosures() const -> std::vector<bool>;
 
-    [[nodiscard]] auto createLocks() const -> std::vector<std::unique_ptr<std::mutex>>;
+    [[nodiscard]] auto compilePlans() const -> PropagationPlans;
 
-    [[nodiscard]] auto createVariables() const -> std::vector<int>;
+    [[nodiscard]] auto createClosureCache() const -> std::unique_ptr<BoundedCache<VariableId, CompiledClosure>>;
+
+    [[nodiscard]] auto compileClosure(VariableId primaryID) const -> std::shared_ptr<const CompiledClosure>;
+
+    [[nodiscard]] auto closureOf(size_t primaryID, ClosureUse use) const -> ClosureHandle;
+
+    void reportClosureCache() const;
+
+    [[nodiscard]] auto createOrderedInputs() const -> std::vector<std::map<Value, size_t>>;
+
+    [[nodiscard]] auto createLazyFlags() const -> std::vector<std::atomic<bool>>;
+
+    void rebuildOrderedInputs(size_t variableID);
+
+    template<typename Values>
+    [[nodiscard]] auto aggregate(size_t variableID, const Values &values) const -> Value;
+
+    [[nodiscard]] auto refresh(size_t variableID) -> Value;
+
+    [[nodiscard]] auto resolveStaleValues() const -> ValueVector;
+
+    [[nodiscard]] auto createLocks() const -> HugePageVector<VariableLock>;
+
+    [[nodiscard]] auto createVariables() const -> ValueVector;
+
+    /// also seeds random() when a seed is given, before any other member draws from it
+    [[nodiscard]] auto createClock() const -> std::shared_ptr<Clock>;
+
+    [[nodiscard]] auto createHistories() const -> std::vector<ValueHistory>;
+
+    void recordHistory(size_t primaryID);
+
+    [[nodiscard]] auto evaluateAt(const std::vector<VariableId> &targets, TimePoint time) const -> SparseValues;
+
+    void verifyHistory() const;
 
     [[nodiscard]] auto getAllDependents(size_t variableID) const -> std::set<size_t>;
 
-    void updateVariable(size_t variableId, int delta);
+    /// Adds change to the primary, or replaces its value with change if isNewValue
+    void updateVariable(size_t variableId, Value change, bool isNewValue = false);
+
+    void recordLockWait(size_t primaryID, std::chrono::steady_clock::time_point start, size_t lockCount);
+
+    void applyInputChange(size_t variableID, const InputChange &change);
+
+    void propagateThroughAggregates(const SharedRunAdjacency::Row &closure, Value delta);
 
     void checkConsistency() const;
 
+    [[nodiscard]] auto collectPrimaries() const -> std::vector<VariableId>;
+
+    [[nodiscard]] auto collectSecondaries() const -> std::vector<VariableId>;
+
+    [[nodiscard]] auto computeChecksumCoefficients() const -> std::vector<Value>;
+
+    [[nodiscard]] auto computePrimaryChecksumWeights() const -> std::vector<Value>;
+
+    void recordChecksumChange(Value change, Value magnitude);
+
+    [[nodiscard]] auto verifyChecksum() const -> bool;
+
+    void rebaseChecksum() const;
+
+    [[nodiscard]] auto computeCheckSampleSize() const -> size_t;
+
+    [[nodiscard]] auto sampleConsistency() const -> bool;
+
+    [[nodiscard]] auto detectionProbability(uint64_t ticks) const -> double;
+
+    void reportCheckCoverage() const;
+
+    void adaptPropagation();
+
+    void recordCommit(std::chrono::steady_clock::time_point start);
+
+    [[nodiscard]] auto computeAssignment(const std::vector<double> &loads, const std::vector<double> &contention,
+                                         const Assignment *previous) const -> std::shared_ptr<const Assignment>;
+
+    [[nodiscard]] auto createAssignment() const -> std::shared_ptr<const Assignment>;
+
+    void rebalanceAffinities();
+
+    [[nodiscard]] auto pickPrimary(size_t workerIndex) const -> size_t;
+
+    [[nodiscard]] auto createWorkerCpus() const -> std::vector<Numa::Cpu>;
+
+    template<typename T>
+    [[nodiscard]] auto placeArray(HugePageVector<T> &array, const std::vector<int> &nodeByVariable) const -> size_t;
+
+    [[nodiscard]] auto placeMemory() -> size_t;
+
+    void reportStatistics(const std::stop_token &stopToken) const;
+
     void startThreads();
 
     void gatherThreads();
 
+    VariableSystem(const std::vector<Definition> &&definitions, size_t visibleSize, const Options &options);
+
 public:
-    explicit VariableSystem(const std::vector<std::vector<size_t>> &&deps);
+    /// Unweighted inputs; listing an id several times counts it several times, as in `{8, 9, 2, 2}`
+    explicit VariableSystem(const std::vector<std::vector<size_t>> &&deps, const Options &options = {});
+
+    /// Weighted inputs; each secondary is the sum of `weight * input` over its dependencies
+    explicit VariableSystem(const std::vector<std::vector<Dependency>> &&deps, const Options &options = {});
+
+    explicit VariableSystem(const std::vector<Definition> &&definitions, const Options &options = {});
+
+    [[nodiscard]] auto readVariable(size_t variableID) -> Value;
+
+    /// Notification of a new value for a primary. Sequence numbers are per primary; a set numbered at or below
+    /// one already accepted is dropped. Sets arriving while an earlier one propagates are coalesced, so only the
+    /// newest of them is propagated once the earlier one is done
+    auto setPrimary(size_t variableID, Value newValue, uint64_t sequence) -> SetOutcome;
+
+    /// History option only: the value the variable had at time, computed from the primaries' logged values then;
+    /// times before a primary's oldest value still retained (see historyCheckpoints) read as that value
+    [[nodiscard]] auto valueAt(size_t variableID, TimePoint time) const -> Value;
+
+    /// History option only: the visible variables whose values at the two times differ, by id
+    [[nodiscard]] auto diff(TimePoint from, TimePoint to) const -> std::vector<Change>;
 };
 
 #endif //LAB01_NONCOOPERATIVEMULTITHREADING_VARIABLESYSTEM_HPP
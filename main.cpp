@@ -1,8 +1,17 @@
 
+#include "GraphFile.hpp"
 #include "VariableSystem.hpp"
 
+#include <charconv>
 #include <chrono>
+#include <csignal>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <string_view>
+#include <thread>
+#include <vector>
 // 3. Summation with fixed structure of inputs
 //
 // We have to keep the values of some integer variables.
@@ -27,27 +36,149 @@
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "cppcoreguidelines-avoid-magic-numbers"
 
-auto main() -> int {
+auto main(int argc, char **argv) -> int {
+    VariableSystem::Options options;
+    std::string graphPath;
+    for (auto index = 1; index < argc; ++index) {
+        const std::string_view argument(argv[index]);
+        if (argument.starts_with("--metrics=")) {
+            options.metricsPath = argument.substr(std::string_view("--metrics=").size());
+        } else if (argument.starts_with("--checkers=")) {
+            const auto count = argument.substr(std::string_view("--checkers=").size());
+            if (std::from_chars(count.data(), count.data() + count.size(), options.checkerThreads).ec != std::errc{}) {
+                std::cerr << "Invalid checker count " << count << '\n';
+                return 1;
+            }
+        } else if (argument.starts_with("--check-confidence=")) {
+            const auto confidence = argument.substr(std::string_view("--check-confidence=").size());
+            if (std::from_chars(confidence.data(), confidence.data() + confidence.size(),
+                                options.checkConfidence).ec != std::errc{}) {
+                std::cerr << "Invalid check confidence " << confidence << '\n';
+                return 1;
+            }
+        } else if (argument.starts_with("--simulate=")) {
+            const auto seed = argument.substr(std::string_view("--simulate=").size());
+            options.seed.emplace();
+            if (std::from_chars(seed.data(), seed.data() + seed.size(), *options.seed).ec != std::errc{}) {
+                std::cerr << "Invalid simulation seed " << seed << '\n';
+                return 1;
+            }
+            options.clock = std::make_shared<VirtualClock>(*options.seed);
+        } else if (argument.starts_with("--plan-cache=")) {
+            options.planCachePath = argument.substr(std::string_view("--plan-cache=").size());
+        } else if (argument.starts_with("--closure-cache=")) {
+            const auto bytes = argument.substr(std::string_view("--closure-cache=").size());
+            if (std::from_chars(bytes.data(), bytes.data() + bytes.size(),
+                                options.closureCacheBytes).ec != std::errc{}) {
+                std::cerr << "Invalid closure cache size " << bytes << '\n';
+                return 1;
+            }
+        } else if (argument.starts_with("--history-checkpoints=")) {
+            const auto checkpoints = argument.substr(std::string_view("--history-checkpoints=").size());
+            if (std::from_chars(checkpoints.data(), checkpoints.data() + checkpoints.size(),
+                                options.historyCheckpoints).ec != std::errc{}) {
+                std::cerr << "Invalid history retention " << checkpoints << '\n';
+                return 1;
+            }
+        } else if (argument.starts_with("--graph=")) {
+            graphPath = argument.substr(std::string_view("--graph=").size());
+        } else if (argument.starts_with("--max-fan-in=")) {
+            const auto fanIn = argument.substr(std::string_view("--max-fan-in=").size());
+            if (std::from_chars(fanIn.data(), fanIn.data() + fanIn.size(), options.maxFanIn).ec != std::errc{}) {
+                std::cerr << "Invalid maximum fan-in " << fanIn << '\n';
+                return 1;
+            }
+        } else if (argument == "--propagation=eager") {
+            options.propagation = PropagationMode::Eager;
+        } else if (argument == "--propagation=lazy") {
+            options.propagation = PropagationMode::Lazy;
+        } else if (argument == "--propagation=adaptive") {
+            options.propagation = PropagationMode::Adaptive;
+        } else if (argument == "--checksum") {
+            options.checksum = true;
+        } else if (argument == "--history") {
+            options.history = true;
+        } else if (argument == "--service") {
+            options.service = true;
+        } else if (argument == "--no-affinity") {
+            options.affinity = false;
+        } else if (argument == "--pin") {
+            options.pinThreads = true;
+        } else if (argument == "--placement=local") {
+            options.placement = MemoryPlacement::Local;
+        } else if (argument == "--placement=interleaved") {
+            options.placement = MemoryPlacement::Interleaved;
+        } else if (argument == "--no-huge-pages") {
+            HugePages::setEnabled(false);
+        } else {
+            std::cerr << "Unknown argument " << argument << '\n'
+                      << "Usage: " << argv[0] << " [--graph=<file>] [--max-fan-in=<inputs, 0 for unlimited>]\n"
+                      << "       [--metrics=<prometheus text file>] [--checkers=<count>]\n"
+                      << "       [--propagation=eager|lazy|adaptive] [--check-confidence=<probability>]\n"
+                      << "       [--checksum] [--history] [--history-checkpoints=<segments, 0 for unlimited>]\n"
+                      << "       [--simulate=<seed>] [--plan-cache=<file>] [--closure-cache=<bytes>]\n"
+                      << "       [--service] [--no-affinity] [--pin] [--placement=local|interleaved] [--no-huge-pages]\n";
+            return 1;
+        }
+    }
+    if (options.service && options.clock) {
+        // a service run stops on a signal, which only a real clock's sleeps can observe in time
+        std::cerr << "--service runs in real time and cannot be combined with --simulate\n";
+        return 1;
+    }
+    std::optional<std::vector<VariableSystem::Definition>> definitions;
+    if (!graphPath.empty()) {
+        try {
+            definitions = GraphFile::load(graphPath);
+        } catch (const std::runtime_error &error) {
+            std::cerr << graphPath << ": " << error.what() << '\n';
+            return 1;
+        }
+    }
+    // in service mode SIGINT / SIGTERM are blocked in every thread and turned into a stop request by one waiter
+    std::stop_source stopSource;
+    std::jthread signalWaiter;
+    if (options.service) {
+        sigset_t stopSignals;
+        sigemptyset(&stopSignals);
+        sigaddset(&stopSignals, SIGINT);
+        sigaddset(&stopSignals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+        signalWaiter = std::jthread([stopSignals, &stopSource]() {
+            auto signal = 0;
+            sigwait(&stopSignals, &signal);
+            stopSource.request_stop();
+        });
+        options.stopToken = stopSource.get_token();
+    }
     const auto start = std::chrono::system_clock::now();
-    VariableSystem system({
-                                  {}                /*  0 */,
-                                  {}                /*  1 */,
-                                  {}                /*  2 */,
-                                  {}                /*  3 */,
-                                  {}                /*  4 */,
-                                  {}                /*  5 */,
-                                  {}                /*  6 */,
-                                  {1,  0}                /*  7 */,
-                                  {0,  1}                /*  8 */,
-                                  {2,  3}                /*  9 */,
-                                  {4,  5}                /*  10 */,
-                                  {6,  7}                /*  11 */,
-                                  {8,  9,  2, 2}          /*  12 */,
-                                  {10, 11, 7}            /*  13 */,
-                          });
+    if (definitions) {
+        VariableSystem system(std::move(*definitions), options);
+    } else {
+        VariableSystem system({
+                                      {}                /*  0 */,
+                                      {}                /*  1 */,
+                                      {}                /*  2 */,
+                                      {}                /*  3 */,
+                                      {}                /*  4 */,
+                                      {}                /*  5 */,
+                                      {}                /*  6 */,
+                                      {1,  0}                /*  7 */,
+                                      {0,  1}                /*  8 */,
+                                      {2,  3}                /*  9 */,
+                                      {4,  5}                /*  10 */,
+                                      {6,  7}                /*  11 */,
+                                      {8,  9,  2, 2}          /*  12 */,
+                                      {10, 11, 7}            /*  13 */,
+                              }, options);
+    }
     const auto end = std::chrono::system_clock::now();
     std::cout << "TOTAL EXECUTION TIME = " << std::chrono::duration_cast<std::chrono::seconds>(end - start)
               << " seconds\n";
+    if (options.clock) {
+        std::cout << "SIMULATED TIME = " << std::chrono::duration_cast<std::chrono::milliseconds>(
+                options.clock->now().time_since_epoch()) << '\n';
+    }
     return 0;
 }
 